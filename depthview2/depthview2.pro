@@ -7,11 +7,28 @@ SOURCES += src/main.cpp \
     src/version.cpp \
     src/dvfolderlisting.cpp \
     src/dvthumbnailprovider.cpp \
+    src/dvthumbnailresponse.cpp \
+    src/dvthumbnailviewport.cpp \
+    src/dvkeyframeextractor.cpp \
+    src/dvthumbnailcache.cpp \
+    src/dvimagethumbnailprovider.cpp \
+    src/dvexifreader.cpp \
+    src/dvmporeader.cpp \
+    src/dvstereoimageprovider.cpp \
+    src/dvimageprefetcher.cpp \
+    src/dvstoragemonitor.cpp \
+    src/dvlibraryindexer.cpp \
+    src/dvstereodetector.cpp \
+    src/dvcompositor.cpp \
+    src/dvbatchexporter.cpp \
+    src/dvvideotranscoder.cpp \
     src/dvpluginmanager.cpp \
     src/dvfilevalidator.cpp \
     src/dvvirtualscreenmanager.cpp \
     src/dvwindowhook.cpp \
-    src/dvrenderer.cpp
+    src/dvrenderer.cpp \
+    src/dvfolderscanner.cpp \
+    src/dvmetadataservice.cpp
 
 RESOURCES += qml.qrc
 
@@ -31,13 +48,35 @@ HEADERS += \
     include/dvfolderlisting.hpp \
     include/dvinputinterface.hpp \
     include/dvthumbnailprovider.hpp \
+    include/dvthumbnailresponse.hpp \
+    include/dvfunctiontask.hpp \
+    include/dvthumbnailviewport.hpp \
+    include/dvkeyframeextractor.hpp \
+    include/dvthumbnailcache.hpp \
+    include/dvimagethumbnailprovider.hpp \
+    include/dvexifreader.hpp \
+    include/dvmporeader.hpp \
+    include/dvstereoimageprovider.hpp \
+    include/dvimageprefetcher.hpp \
+    include/dvstoragemonitor.hpp \
+    include/dvlibraryindexer.hpp \
+    include/dvstereodetector.hpp \
+    include/dvcompositor.hpp \
+    include/dvbatchexporter.hpp \
+    include/dvvideotranscoder.hpp \
+    include/dvframequeue.hpp \
+    include/dvtiffreader.hpp \
     include/dvpluginmanager.hpp \
     include/dvfilevalidator.hpp \
     include/dvconfig.hpp \
     include/dvvirtualscreenmanager.hpp \
     include/dv_vrdriver.hpp \
     include/dvwindowhook.hpp \
-    include/dvrenderer.hpp
+    include/dvrenderer.hpp \
+    include/dvfileentry.hpp \
+    include/dvfolderscanner.hpp \
+    include/dvmetadataservice.hpp \
+    include/dvrenderstate.hpp
 
 INCLUDEPATH += include
 
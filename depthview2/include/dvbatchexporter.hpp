@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include "dvvideotranscoder.hpp"
+
+class DVStereoDetector;
+
+/* Converts stereo images and videos from one layout to another without a window or GL context, for the "--export" command line option.
+ * Each image is decoded, split into its eyes and composited by DVCompositor on a thread pool, one file per thread.
+ * Videos are handed to a DVVideoTranscoder, which runs its stages on threads of its own.
+ * How much memory is in use at once is limited by a budget that each file reserves its estimated share of before it is decoded,
+ * so huge panoramas wait for room instead of running alongside each other. */
+class DVBatchExporter {
+public:
+    struct Options {
+        QString outputDir;
+        DVDrawMode::Type drawMode = DVDrawMode::SideBySide;
+        /* -1 to work out the layout of each file from its name, or failing that its contents (see DVStereoDetector). */
+        int sourceMode = -1;
+        /* Swap the eyes, on top of the default swapping of cross-eyed formats (JPS/PNS). */
+        bool swap = false;
+        bool anamorphic = false;
+        qreal greyFacL = 0.0;
+        qreal greyFacR = 0.0;
+        bool mirrorLeft = false;
+        bool mirrorRight = false;
+        /* Anything QImageWriter can write, also used as the suffix of the output files. */
+        QByteArray format = "jpg";
+        int quality = 90;
+        /* The container of exported videos, chosen by suffix. */
+        QByteArray videoFormat = "mp4";
+        QString videoCodec = "libx264";
+        /* In bits per second, 0 leaves it up to the encoder. */
+        int videoBitRate = 0;
+        int threads = QThread::idealThreadCount();
+        int memoryMB = 1024;
+    };
+
+private:
+    const Options options;
+    DVCompositor compositor;
+    DVVideoTranscoder transcoder;
+
+    QThreadPool pool;
+    /* One resource per megabyte of the budget. */
+    QSemaphore memory;
+
+    QAtomicInt exported;
+    QAtomicInt failed;
+
+    /* Input files and the paths to write them to, relative paths in input dirs are kept. */
+    QList<QPair<QString, QString>> collectFiles(const QStringList& inputs);
+
+    /* Reserves memory for a file and converts it. */
+    void exportFile(const QString& input, const QString& output);
+    bool convertImage(const QString& input, const QString& output) const;
+    /* size and firstFrame are what was decoded to estimate the memory needed. */
+    bool convertVideo(const QString& input, const QString& output, const QSize& size, const QImage& firstFrame) const;
+
+    /* The layout of a file from the options or its name. Returns false if neither says, swap is set either way. */
+    bool namedLayout(const QString& file, DVSourceMode::Type& mode, bool& swap) const;
+
+public:
+    explicit DVBatchExporter(const Options& o);
+    ~DVBatchExporter();
+
+    /* Export every image and video in inputs (files or dirs, which are searched recursively), blocking until all are done.
+     * Returns the number of files that failed. */
+    int run(const QStringList& inputs);
+};
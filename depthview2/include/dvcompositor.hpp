@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QImage>
+#include <QPoint>
+#include "dvenums.hpp"
+
+/* Does on the CPU what the draw mode shaders in glsl/ do on the GPU, so that stereo output can be made without a GL context
+ * and the shaders have something to be checked against. Each eye is an image the size of what the shader would read from
+ * its texture, and the result is what the shader would draw to the window.
+ *
+ * Everything but anaglyph just moves pixels around and matches the shaders exactly. Anaglyph is done in fixed point,
+ * which is within one step of rounding of the shader's float math (the same as the difference between most GPUs).
+ * The work is done a row at a time by kernels using AVX2 (chosen at runtime), SSE2 or NEON, with a scalar fallback that
+ * gives the exact same results. Output is always Format_RGBA8888 and opaque, the same as the shaders' output.
+ * VirtualReality isn't a compositing mode and isn't supported. Safe to use from any thread, the instances share nothing. */
+class DVCompositor {
+    qreal greyFacL;
+    qreal greyFacR;
+    bool mirrorL;
+    bool mirrorR;
+    bool anamorphic;
+    QPoint screenOrigin;
+    bool vectorized;
+
+public:
+    DVCompositor();
+
+    /* How much of each eye is turned grey for anaglyph, from 0 (full color) to 1 (all grey). */
+    void setGreyFactors(qreal left, qreal right);
+    /* Flip an eye for side-by-side (horizontally) and top/bottom (vertically), for viewing through mirrors. */
+    void setMirror(bool left, bool right);
+    /* Side-by-side and top/bottom are made the same size as the eyes by squeezing them, otherwise the eyes are put next to each other.
+     * This is the same as rendering the UI at full or half size in DVRenderer::updateQmlSize(). */
+    void setAnamorphic(bool squeeze);
+    /* Where the output would be on the screen. The interlaced and checkerboard patterns follow screen pixels, not window pixels. */
+    void setScreenOrigin(const QPoint& origin);
+    /* Use the vector kernels when there are any, on by default. With it off everything is done by the scalar kernels. */
+    void setVectorized(bool enabled);
+
+    /* Composite the eyes with a draw mode, returning a null image on failure. The eyes must be the same size. */
+    QImage compose(const QImage& left, const QImage& right, DVDrawMode::Type mode) const;
+
+    /* The size compose() makes for eyes of a given size. */
+    QSize outputSize(const QSize& eyeSize, DVDrawMode::Type mode) const;
+
+    /* Split a frame into its eyes the same way DVRenderer::getTextureRects() does, with the left eye first unless swap is set.
+     * Squeezed layouts are stretched back to their full aspect ratio, mono frames are used for both eyes. */
+    static bool splitFrame(const QImage& frame, DVSourceMode::Type mode, bool swap, QImage& left, QImage& right);
+
+    /* The best instruction set the vector kernels can use on this CPU, for logging. */
+    static const char* instructionSet();
+};
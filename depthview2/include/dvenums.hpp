@@ -51,6 +51,20 @@ DV_ENUM(DVPluginType,
         InvalidPlugin,
         InputPlugin)
 
+DV_ENUM(DVSortMode,
+        Name,
+        NaturalName,
+        Size,
+        Date,
+        StereoMode,
+        Type)
+
+DV_ENUM(DVFileFilter,
+        AllFiles,
+        StereoOnly,
+        SurroundOnly,
+        VideoOnly)
+
 DV_ENUM(DVStereoEye,
         LeftEye,
         RightEye)
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+/* Just enough EXIF parsing to get at the JPEG thumbnail that most cameras embed in their files. */
+class DVExifReader {
+public:
+    /* Returns the compressed JPEG data of the thumbnail in IFD1, or an empty array if there isn't one.
+     * Only the start of the file (the APP1 segment, at most 64 KiB) is read. */
+    static QByteArray jpegThumbnail(const QString& file);
+};
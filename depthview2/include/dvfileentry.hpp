@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QString>
+#include <QDateTime>
+#include <QMetaType>
+
+/* A snapshot of everything the file browser needs to know about a single directory entry.
+ * Built once when a directory is listed so that the model never has to go back to the filesystem. */
+struct DVFileEntry {
+    enum Type {
+        Other,
+        Directory,
+        Image,
+        StereoImage,
+        Video
+    };
+
+    /* Just the name of the file, no path. */
+    QString name;
+    /* The absolute path of the file. */
+    QString path;
+
+    qint64 size = 0;
+    QDateTime created;
+    QDateTime modified;
+
+    Type type = Other;
+
+    /* Symlinks are stored in the database under the path of their target, which may be outside the listed directory. */
+    bool isSymLink = false;
+
+    bool isDir() const { return type == Directory; }
+    /* Stereo images are images too. */
+    bool isImage() const { return type == Image || type == StereoImage; }
+    bool isStereoImage() const { return type == StereoImage; }
+    bool isVideo() const { return type == Video; }
+};
+
+/* Entries are passed from the directory scanning thread with queued connections. */
+Q_DECLARE_METATYPE(DVFileEntry)
@@ -2,14 +2,25 @@
 
 #include <QDir>
 #include <QTimer>
+#include <QFileSystemWatcher>
 #include <QUrl>
 #include <QAbstractListModel>
-#include <QSqlRecord>
-#include <QMutex>
+#include <QVector>
+#include <QThread>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QSet>
 #include "dvenums.hpp"
+#include "dvfileentry.hpp"
+#include "dvmetadataservice.hpp"
+#include "dvrenderstate.hpp"
 
 class QSettings;
 class DVQmlCommunication;
+class DVFolderScanner;
+class DVStorageMonitor;
+class DVLibraryIndexer;
+class DVThumbnailViewport;
 
 class DVFolderListing : public QAbstractListModel {
     Q_OBJECT
@@ -19,7 +30,82 @@ class DVFolderListing : public QAbstractListModel {
     QDir m_currentDir;
     QFileInfo m_currentFile;
 
+    /* Snapshot of the entries in m_currentDir, filled in by the scanner whenever the directory changes.
+     * Entries stay where they are once added, the model rows are a sorted and filtered index into them. */
+    QVector<DVFileEntry> entries;
+    /* The index in entries of each path. */
+    QHash<QString, int> entryIndexes;
+    /* What each entry is sorted by (besides its name) in the current sort mode. */
+    QVector<qint64> sortKeys;
+
+    /* The index in entries of the entry shown in each row. */
+    QVector<int> rows;
+    /* The row of each entry, or -1 if it's filtered out. */
+    QVector<int> entryRows;
+    /* The entries that can be opened (everything but dirs), in the order openNext() steps through them. */
+    QVector<int> fileOrder;
+    /* For each entry, its index in fileOrder (or -1 if it's a dir or filtered out). */
+    QVector<int> fileIndexes;
+    /* The index of m_currentFile in fileOrder, or -1 if it hasn't been listed (yet). */
+    int currentFileIndex;
+
+    DVSortMode::Type m_sortMode;
+    bool m_sortDescending;
+    DVFileFilter::Type m_fileFilter;
+
+    qint64 sortKey(const DVFileEntry& entry) const;
+    void updateSortKeys();
+    /* Does entries[a] go before entries[b] in the current sort order? */
+    bool entryLessThan(int a, int b) const;
+    bool isEntryShown(int index) const;
+
+    /* Do the sort or the filter depend on the stored records? If so they need to be reapplied when those change. */
+    bool orderUsesRecords() const;
+
+    /* Add entries to the rows in sorted order, the entries must already be in entries. */
+    void showEntries(QVector<int> indexes);
+    /* Take entries out of the rows. */
+    void hideEntries(const QVector<int>& indexes);
+    /* Sort and filter every entry again, moving rows around if just the order changed or resetting the model otherwise. */
+    void updateRows();
+    /* Rebuild entryRows, fileOrder and fileIndexes after the rows changed. */
+    void updateRowIndexes();
+    /* Look the current file up in the index, to be called whenever it or the index changes. */
+    void updateCurrentFileIndex();
+
+    /* Open the file offset places from the current one, wrapping around at either end. */
+    void openAdjacentFile(int offset);
+
+    /* Directories are listed on this thread so that large or slow directories don't block the UI. */
+    QThread scanThread;
+    DVFolderScanner* scanner;
+
+    /* Incremented for every new scan, so that results from a stale scan can be ignored and the scan can stop early. */
+    QAtomicInt scanGeneration;
+    bool m_scanning;
+    /* The entries are search results instead of the contents of m_currentDir. */
+    bool m_searchResultsShown;
+
+    /* Forget the entries and stop watching for changes, ready for something else to be listed. */
+    void clearEntries();
+
+    /* The number of children of each dir that has been counted, along with the modification time of the dir when it was counted. */
+    mutable QHash<QString, QPair<QDateTime, int>> childCounts;
+    /* Dirs waiting to be counted, so that each is only requested once. */
+    mutable QSet<QString> pendingChildCounts;
+
+    /* Get the cached number of children of a dir entry, or request a count and return -1 if it isn't known yet. */
+    int childCount(const DVFileEntry& entry) const;
+
+    /* Watches m_currentDir, changes are picked up by listing it again and comparing the result to the entries. */
+    QFileSystemWatcher dirWatcher;
+    /* Files tend to change in bursts (e.g. something writing a sequence of images), so rescans are delayed a little. */
+    QTimer rescanTimer;
+    /* The dir changed during a scan, rescan once it has finished. */
+    bool rescanPending;
+
     QStringList stereoImageSuffixes;
+    QStringList swappedStereoImageSuffixes;
     QStringList imageSuffixes;
     QStringList videoSuffixes;
 
@@ -28,12 +114,43 @@ class DVFolderListing : public QAbstractListModel {
 
     QStringList m_bookmarks;
 
-    QTimer driveTimer;
+    /* Keeps the list of drives up to date in the background. */
+    QThread storageThread;
+    DVStorageMonitor* storage;
 
     bool m_fileBrowserOpen;
 
-    /* Only one database operation can be running at once. */
-    mutable QMutex dbOpMutex;
+    /* All SQL happens on this thread, so that nothing else has to wait for the database. */
+    QThread metadataThread;
+    DVMetadataService* metadata;
+
+    /* Fills in the database for everything under the library roots. */
+    DVLibraryIndexer* indexer;
+
+    /* Database records keyed by canonical path. Holds every record in the current dir (loaded in the background
+     * whenever the dir changes) plus any other files that were looked up. Kept up to date by updateRecordForFile(). */
+    mutable QHash<QString, QVariantHash> dirRecords;
+    /* The canonical path (with a trailing slash) of the directory dirRecords was loaded for, and the path it was listed with. */
+    QString dirRecordsPath;
+    QString dirRecordsListedPath;
+    /* False until the records for the current dir have arrived. */
+    bool dirRecordsLoaded;
+    /* Records of files outside the current dir that have been requested from the database, keyed like dirRecords,
+     * with the paths they were requested for (which differ from the key for symlinks). */
+    mutable QHash<QString, QStringList> pendingRecords;
+
+    /* The DVRenderState of the current file packed into one value,
+     * so that any thread (in particular the render thread) can read it without locking or touching the database. */
+    QAtomicInt currentFileState;
+
+    /* The rows last passed to setVisibleRows(), kept to tell the viewport about the paths again when the rows change. */
+    int visibleFirst;
+    int visibleLast;
+    /* Give the thumbnail viewport the paths of the rows around the visible ones. */
+    void updateThumbnailViewport();
+
+    /* Recalculate currentFileState, emitting change signals for anything that changed. */
+    void updateCurrentFileState();
 
     Q_PROPERTY(QString currentFile READ currentFile NOTIFY currentFileChanged)
     Q_PROPERTY(QUrl currentURL READ currentURL NOTIFY currentFileChanged)
@@ -46,11 +163,19 @@ class DVFolderListing : public QAbstractListModel {
     Q_PROPERTY(bool currentFileIsSurround READ isCurrentFileSurround WRITE setCurrentFileSurround NOTIFY currentFileSurroundChanged)
     Q_PROPERTY(DVSourceMode::Type currentFileStereoMode READ currentFileStereoMode WRITE setCurrentFileStereoMode NOTIFY currentFileStereoModeChanged)
     Q_PROPERTY(bool currentFileStereoSwap READ currentFileStereoSwap WRITE setCurrentFileStereoSwap NOTIFY currentFileStereoSwapChanged)
+    /* Whether the current file is swapped when nothing is stored for it, only true for cross-eyed stereo images (JPS & PNS). */
+    Q_PROPERTY(bool currentFileDefaultSwap READ currentFileDefaultSwap NOTIFY currentFileChanged)
     Q_PROPERTY(qint64 currentFileSize READ currentFileSize NOTIFY currentFileChanged)
     Q_PROPERTY(QString currentFileInfo READ currentFileInfo NOTIFY currentFileChanged)
 
     Q_PROPERTY(QUrl currentDir READ currentDir WRITE setCurrentDir NOTIFY currentDirChanged)
 
+    /* True while the current dir is still being listed. */
+    Q_PROPERTY(bool scanning READ scanning NOTIFY scanningChanged)
+
+    /* True while the model is showing the results of search() instead of the current dir. */
+    Q_PROPERTY(bool searchResultsShown READ searchResultsShown NOTIFY searchResultsShownChanged)
+
     /* By making this a property we can emit a signal when the list needs to be updated. */
     Q_PROPERTY(QStringList storageDevicePaths READ getStorageDevicePaths NOTIFY storageDevicePathsChanged)
 
@@ -64,11 +189,21 @@ class DVFolderListing : public QAbstractListModel {
 
     Q_PROPERTY(bool fileBrowserOpen READ fileBrowserOpen WRITE setFileBrowserOpen NOTIFY fileBrowserOpenChanged)
 
+    /* How the file browser is sorted and filtered, changing these doesn't need the directory to be listed again. */
+    Q_PROPERTY(DVSortMode::Type sortMode READ sortMode WRITE setSortMode NOTIFY sortModeChanged)
+    Q_PROPERTY(bool sortDescending READ sortDescending WRITE setSortDescending NOTIFY sortDescendingChanged)
+    Q_PROPERTY(DVFileFilter::Type fileFilter READ fileFilter WRITE setFileFilter NOTIFY fileFilterChanged)
+
+    /* Dirs whose whole trees are indexed in the background. */
+    Q_PROPERTY(QStringList libraryRoots READ libraryRoots WRITE setLibraryRoots NOTIFY libraryRootsChanged)
+    Q_PROPERTY(bool libraryIndexing READ libraryIndexing NOTIFY libraryIndexingChanged)
+
     Q_PROPERTY(QString startDir READ startDir WRITE setStartDir NOTIFY startDirChanged)
     Q_PROPERTY(QString snapshotDir READ snapshotDir WRITE setSnapshotDir NOTIFY snapshotDirChanged)
 
 public:
     explicit DVFolderListing(QObject* parent, QSettings& s);
+    ~DVFolderListing();
 
     /* Just the name of the current file, no path. */
     QString currentFile() const;
@@ -122,6 +257,9 @@ public:
     Q_INVOKABLE void openNext();
     Q_INVOKABLE void openPrevious();
 
+    /* The images that openNext() and openPrevious() would lead to, closest first, alternating between the two directions. */
+    QStringList neighbouringImages(int ahead, int behind) const;
+
     Q_INVOKABLE QString bytesToString(qint64 bytes) const;
 
     /* Begin Model stuff... */
@@ -139,7 +277,14 @@ public:
         FileTypeStringRole
     };
 
-    QSqlRecord getRecordForFile(const QFileInfo& file) const;
+    /* Records that aren't cached yet are loaded in the background, an empty record is returned until recordArrived(). */
+    QVariantHash getRecordForFile(const QFileInfo& file) const;
+
+    /* Start loading the records for every file in the current dir into dirRecords. */
+    void loadDirRecords();
+
+    /* Everything about the current file needed to draw it, safe to call from any thread. */
+    DVRenderState currentRenderState() const;
 
     bool isCurrentFileStereoImage() const;
     bool isCurrentFileImage() const;
@@ -156,9 +301,12 @@ public:
 
     bool currentFileStereoSwap() const;
     void setCurrentFileStereoSwap(bool swap);
+    bool currentFileDefaultSwap() const;
 
     void updateRecordForFile(const QFileInfo& file, const QString& propertyName, QVariant value);
     void updateRecordForFile(const QFileInfo& file, const QString& propertyName, QVariant value, Roles role);
+    /* Set several values for a file at once, they will be written in a single statement. */
+    void updateRecordForFile(const QFileInfo& file, const QVariantHash& values);
 
     qint64 currentFileSize() const;
     QString currentFileInfo() const;
@@ -172,6 +320,20 @@ public:
     DVSourceMode::Type fileStereoMode(const QFileInfo& file) const;
     bool fileStereoSwap(const QFileInfo& file) const;
 
+    /* The same checks as above, but working from a snapshot entry so that the filesystem doesn't need to be touched. */
+    DVFileEntry entryForFile(const QFileInfo& file) const;
+    DVFileEntry::Type fileType(const QFileInfo& file) const;
+
+    QVariantHash getRecordForEntry(const DVFileEntry& entry) const;
+    QString fileTypeString(const DVFileEntry& entry) const;
+    bool isFileSurround(const DVFileEntry& entry) const;
+    DVSourceMode::Type fileStereoMode(const DVFileEntry& entry) const;
+    bool fileStereoSwap(const DVFileEntry& entry) const;
+    bool defaultStereoSwap(const DVFileEntry& entry) const;
+
+    /* Find the row of a file in the current snapshot, or -1 if it isn't in the current dir (or is filtered out). */
+    int rowForFile(const QFileInfo& file) const;
+
     QHash<int, QByteArray> roleNames() const;
 
     /* The function that gives QML the different properties for a given file in the current dir. */
@@ -182,6 +344,34 @@ public:
 
     bool initDir(const QString& dir);
 
+    /* Clear the entry snapshot and start listing m_currentDir in the background, cancelling any scan in progress.
+     * Must be called between beginResetModel() and endResetModel(). */
+    void startScan();
+
+    bool scanning() const;
+
+    /* Show the indexed files matching the text and filters (see DVMetadataService::search()) in place of the current dir.
+     * Opening one of the results keeps them listed, so openNext() and openPrevious() step through the results. */
+    Q_INVOKABLE void search(const QString& text, const QVariantMap& filters = QVariantMap());
+    /* Go back to listing the current dir. */
+    Q_INVOKABLE void clearSearch();
+    bool searchResultsShown() const;
+
+    DVSortMode::Type sortMode() const;
+    void setSortMode(DVSortMode::Type mode);
+    bool sortDescending() const;
+    void setSortDescending(bool descending);
+    DVFileFilter::Type fileFilter() const;
+    void setFileFilter(DVFileFilter::Type filter);
+
+    QStringList libraryRoots() const;
+    void setLibraryRoots(const QStringList& roots);
+    bool libraryIndexing() const;
+
+    /* Index the library roots again, picking up anything that changed since the last time. */
+    Q_INVOKABLE void indexLibrary();
+    Q_INVOKABLE void cancelLibraryIndexing();
+
     QString startDir();
     void setStartDir(QString path);
 
@@ -191,9 +381,12 @@ public:
     bool fileBrowserOpen() const;
     void setFileBrowserOpen(bool open);
 
-    void setupFileDatabase();
     Q_INVOKABLE void resetFileDatabase();
 
+    /* Tell the thumbnail providers which rows the file browser is showing, so that those thumbnails are made first. */
+    Q_INVOKABLE void setVisibleRows(int first, int last);
+    QSharedPointer<DVThumbnailViewport> thumbnailViewport;
+
     DVQmlCommunication* qmlCommunication;
 
 signals:
@@ -209,8 +402,41 @@ signals:
 
     void fileBrowserOpenChanged();
 
+    void libraryRootsChanged();
+    void libraryIndexingChanged();
+
+    void sortModeChanged();
+    void sortDescendingChanged();
+    void fileFilterChanged();
+
     void currentFileStereoModeChanged();
     void currentFileStereoSwapChanged();
     void currentFileSurroundChanged();
     void currentFileAudioTrackChanged();
+
+    void scanningChanged();
+    void searchResultsShownChanged();
+
+    /* Used to pass scan requests to the scanner thread. */
+    void scanRequested(int generation, const QString& dir, const QStringList& nameFilters);
+    void rescanRequested(int generation, const QString& dir, const QStringList& nameFilters);
+    void listRequested(int generation, const QStringList& paths);
+
+private slots:
+    void entriesFound(int generation, const QVector<DVFileEntry>& newEntries);
+    void scanFinished(int generation);
+
+    void dirModified();
+    void startRescan();
+    /* Compare the new listing to the entries, inserting and removing rows for whatever changed. */
+    void rescanFinished(int generation, const QVector<DVFileEntry>& newEntries);
+
+    void childrenCounted(const QString& dir, const QDateTime& modified, int count);
+
+    void dirRecordsArrived(const QString& dir, const DVDirRecords& records);
+    void recordArrived(const QString& dir, const QString& name, const QVariantHash& record);
+    void searchFinished(int generation, const DVDirRecords& records);
+
+    /* Keep the cached records up to date with what the library indexer finds. */
+    void fileIndexed(const QString& dir, const QString& name, const QVariantHash& values);
 };
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QObject>
+#include <QVector>
+#include <QAtomicInt>
+#include "dvfileentry.hpp"
+
+class DVFolderListing;
+
+/* Lists directories on a worker thread, streaming the sorted entries back to DVFolderListing in batches. */
+class DVFolderScanner : public QObject {
+    Q_OBJECT
+
+    /* Used to classify the entries, only const functions that don't touch the model are called. */
+    const DVFolderListing& folderListing;
+
+    /* The generation of the most recently requested scan. A scan with any other generation is stale and stops early. */
+    const QAtomicInt& currentGeneration;
+
+    bool isStale(int generation) const;
+
+    /* Get the entries of a dir in sorted order, calling found with each batch. Returns false if the scan went stale. */
+    template <typename Function> bool list(int generation, const QString& dir, const QStringList& nameFilters, Function found);
+
+public:
+    DVFolderScanner(const DVFolderListing& f, const QAtomicInt& generation);
+
+    /* The order entries are listed in, the same as QDir's "DirsFirst | Name | IgnoreCase" with ties broken by case. */
+    static bool lessThan(bool aIsDir, const QString& a, bool bIsDir, const QString& b);
+    /* Compare just the names in that order, returning less than, equal to or greater than zero. */
+    static int compareNames(const QString& a, const QString& b);
+
+public slots:
+    void scan(int generation, const QString& dir, const QStringList& nameFilters);
+
+    /* List a dir again to pick up changes, all of the entries are sent at once so they can be compared to the old ones. */
+    void rescan(int generation, const QString& dir, const QStringList& nameFilters);
+
+    /* Get entries for files from anywhere (e.g. search results), streamed back like a scan. Files that are gone are skipped. */
+    void listFiles(int generation, const QStringList& paths);
+
+    /* Count everything in a dir without sorting or getting any info about the entries. modified is passed back with the count. */
+    void countChildren(const QString& dir, const QDateTime& modified);
+
+signals:
+    void entriesFound(int generation, const QVector<DVFileEntry>& entries);
+    void scanFinished(int generation);
+
+    void rescanFinished(int generation, const QVector<DVFileEntry>& entries);
+
+    void childrenCounted(const QString& dir, const QDateTime& modified, int count);
+};
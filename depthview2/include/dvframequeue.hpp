@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+/* A queue between two threads that holds at most a fixed number of items. Pushing waits while it's full and popping waits while
+ * it's empty, so a fast producer can't get further ahead of a slow consumer than the length of the queue.
+ * Either side can close it, the producer when it has nothing more and the consumer when it has given up. */
+template<typename T>
+class DVFrameQueue {
+    QMutex lock;
+    QWaitCondition notFull;
+    QWaitCondition notEmpty;
+
+    QQueue<T> items;
+    const int capacity;
+    bool closed;
+
+public:
+    explicit DVFrameQueue(int length) : capacity(qMax(1, length)), closed(false) { }
+
+    /* Returns false if the queue has been closed, in which case the item is dropped. */
+    bool push(const T& item) {
+        QMutexLocker locker(&lock);
+
+        while (!closed && items.size() >= capacity)
+            notFull.wait(&lock);
+
+        if (closed) return false;
+
+        items.enqueue(item);
+        notEmpty.wakeOne();
+
+        return true;
+    }
+
+    /* Returns false once the queue has been closed and everything in it has been taken. */
+    bool pop(T& item) {
+        QMutexLocker locker(&lock);
+
+        while (!closed && items.isEmpty())
+            notEmpty.wait(&lock);
+
+        if (items.isEmpty()) return false;
+
+        item = items.dequeue();
+        notFull.wakeOne();
+
+        return true;
+    }
+
+    /* Wakes up everyone waiting, nothing more can be pushed. */
+    void close() {
+        QMutexLocker locker(&lock);
+
+        closed = true;
+        notFull.wakeAll();
+        notEmpty.wakeAll();
+    }
+};
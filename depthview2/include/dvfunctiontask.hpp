@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QRunnable>
+#include <functional>
+
+/* Runs a function on a QThreadPool. (QRunnable::create() needs Qt 5.15.) */
+class DVFunctionTask : public QRunnable {
+    std::function<void()> task;
+
+public:
+    explicit DVFunctionTask(std::function<void()> t) : task(t) { }
+
+    virtual void run() override { task(); }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QObject>
+#include <QCache>
+#include <QDateTime>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+class QSettings;
+class DVFolderListing;
+
+/* Decodes the images around the current one in the background, so that stepping to the next or previous image
+ * doesn't have to wait for a decode. Decoded images are kept within a memory budget, least recently used first out.
+ * Settings: "PrefetchAhead" & "PrefetchBehind" (number of files), "PrefetchMemoryMB". */
+class DVImagePrefetcher : public QObject {
+    Q_OBJECT
+
+    DVFolderListing& folderListing;
+
+    int ahead;
+    int behind;
+
+    struct Entry {
+        QImage image;
+        QSize originalSize;
+        /* So that a file that changed since it was decoded isn't shown. */
+        QDateTime modified;
+    };
+
+    QMutex lock;
+    /* Signalled whenever a decode finishes. */
+    QWaitCondition decoded;
+    /* Cost is in kilobytes. */
+    QCache<QString, Entry> cache;
+    /* Files currently being decoded. Only added to once a decode has actually started,
+     * so that queued prefetches can be dropped without anyone waiting on them. */
+    QSet<QString> inProgress;
+
+    QThreadPool pool;
+
+    /* Decode a file and add it to the cache. lock must not be locked. */
+    Entry decodeAndStore(const QString& file);
+
+    /* Get a cached entry if it's still valid. lock must be locked. */
+    const Entry* findLocked(const QString& file);
+
+    /* Run on the pool, decodes the file unless it has been decoded since it was queued. */
+    void prefetchFile(const QString& file);
+
+public:
+    DVImagePrefetcher(QSettings& settings, DVFolderListing& f);
+    ~DVImagePrefetcher();
+
+    /* Get a full size image, waiting for it if it's being prefetched or decoding it right away otherwise. Safe to call from any thread. */
+    QImage image(const QString& file, QSize* originalSize = nullptr);
+
+    /* Decode an image, packing stereo formats that QML can't load (MPO) side by side. */
+    static QImage decode(const QString& file, const QSize& requestedSize, QSize* originalSize = nullptr);
+
+public slots:
+    /* Start decoding the files around the current one. */
+    void prefetch();
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QQuickAsyncImageProvider>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+class DVThumbnailCache;
+class DVThumbnailResponse;
+
+/* Thumbnails for image files, made in parallel and stored in the thumbnail cache.
+ * Uses the cheapest source that is good enough: the embedded EXIF thumbnail, then a scaled JPEG decode, then a full decode. */
+class DVImageThumbnailProvider : public QQuickAsyncImageProvider {
+    QSharedPointer<DVThumbnailCache> cache;
+
+    QThreadPool pool;
+
+    /* Run on pool. */
+    void load(DVThumbnailResponse* response);
+
+    /* Returns a null image on failure. originalSize is set to the size of the full image. */
+    static QImage loadThumbnail(const QString& file, const QSize& requestedSize, QSize& originalSize);
+
+public:
+    explicit DVImageThumbnailProvider(const QSharedPointer<DVThumbnailCache>& thumbnailCache);
+    ~DVImageThumbnailProvider();
+
+    virtual QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
+};
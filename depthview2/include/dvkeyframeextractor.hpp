@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+
+/* Grabs a single frame from a video as cheaply as possible: the duration is probed once,
+ * the demuxer seeks straight to the keyframe nearest a fraction of the way through,
+ * and only that keyframe is decoded (at reduced resolution where the codec supports it). */
+class DVKeyframeExtractor {
+    qreal positionFraction;
+    bool reducedResolution;
+
+public:
+    /* position is the fraction of the video's duration to take the frame from. */
+    explicit DVKeyframeExtractor(qreal position = 0.2);
+
+    void setPosition(qreal position);
+    qreal position() const;
+
+    /* Whether the codec may decode at reduced resolution, on by default. Turn it off when the real size of the video is needed. */
+    void setReducedResolution(bool reduced);
+
+    /* Returns a frame scaled to fit inside requestedSize (or full size if it isn't valid),
+     * or a null image on failure. If originalSize isn't null it is set to the size of the decoded frame,
+     * which keeps the video's aspect ratio but may be smaller than the video when decoded at reduced resolution. */
+    QImage extract(const QString& file, const QSize& requestedSize, QSize* originalSize = nullptr) const;
+};
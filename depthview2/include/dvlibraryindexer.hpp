@@ -0,0 +1,81 @@
+#pragma once
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QVariantHash>
+#include "dvenums.hpp"
+
+class QFileInfo;
+class DVFolderListing;
+class DVMetadataService;
+
+/* Crawls whole library trees in the background, recording what kind of file each one is along with its size,
+ * resolution and a guess at its stereo layout (see DVStereoDetector) in the metadata database. Each dir is walked as its own task,
+ * so several dirs are listed at once. Files whose size and modification time match their record are skipped,
+ * so after the first run only what changed is looked at again. */
+class DVLibraryIndexer : public QObject {
+    Q_OBJECT
+
+    DVMetadataService& metadata;
+    /* Used to classify files, only const functions that don't touch the model are called. */
+    const DVFolderListing& folderListing;
+
+    QThreadPool pool;
+
+    /* Dirs that are queued or being walked. When it reaches zero the run is done. */
+    QAtomicInt pendingDirs;
+    QAtomicInt cancelled;
+    QAtomicInt indexedFiles;
+
+    /* Canonical paths of the dirs already walked this run, so that symlinks can't lead in circles. */
+    QMutex visitedLock;
+    QSet<QString> visitedDirs;
+
+    bool m_running;
+    /* The roots of the current run, and roots asked for while it was going that get a run of their own once it's done. */
+    QStringList runRoots;
+    QStringList queuedRoots;
+
+    /* Queue a dir to be walked, unless it already has been. */
+    void queueDir(const QString& dir);
+    /* Called when a dir is done, the last one finishes the run. */
+    void releaseDir();
+    void indexDir(const QString& dir);
+
+    /* Does the record of a file need to be updated? */
+    static bool needsProbe(const QFileInfo& file, const QVariantHash& record);
+    /* Probe a file and write its record. */
+    void recordFile(const QString& dir, const QFileInfo& file, int type);
+    /* Everything that is recorded about a file, including its layout detected from a few frames. */
+    QVariantHash probeFile(const QFileInfo& file, int type) const;
+
+public:
+    DVLibraryIndexer(DVMetadataService& m, const DVFolderListing& f);
+    ~DVLibraryIndexer();
+
+    bool isRunning() const;
+
+    /* Start indexing everything under roots. If a run is already going, any roots it doesn't cover are indexed after it. */
+    void start(const QStringList& roots);
+    /* Stop as soon as possible, anything already recorded is kept. */
+    void cancel();
+
+    /* Index a single file in the background (if it changed since it was last indexed), wherever it is. */
+    void indexFile(const QString& path);
+
+    /* Guess the layout of a file from the words in its name (e.g. "Movie.Half-SBS.mkv"). Returns false if there are none. */
+    static bool layoutFromName(const QString& fileName, DVSourceMode::Type& mode, qreal& confidence);
+
+signals:
+    void runningChanged();
+    void finished(int indexedFiles);
+
+    /* Emitted from the pool's threads whenever a record is written. */
+    void fileIndexed(const QString& dir, const QString& name, const QVariantHash& values);
+
+private slots:
+    void runFinished();
+};
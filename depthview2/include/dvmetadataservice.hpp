@@ -0,0 +1,104 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QPair>
+#include <QSqlQuery>
+#include <QVariantHash>
+
+class QTimer;
+class QSqlDatabase;
+
+/* Records for a directory, keyed by file name. */
+typedef QHash<QString, QVariantHash> DVDirRecords;
+
+/* Owns the file metadata database, running all SQL on its own thread with its own connection,
+ * so that the GUI and render threads never have to wait on SQLite I/O.
+ * The public functions can be called from any thread, results are delivered with signals. */
+class DVMetadataService : public QObject {
+    Q_OBJECT
+
+    const QString databasePath;
+    const QString connectionName;
+
+    /* Everything below is only ever used from the service thread. */
+
+    /* Queries that are run all the time are only prepared once. */
+    QSqlQuery recordQuery;
+    QSqlQuery dirRecordsQuery;
+    QSqlQuery insertQuery;
+    QSqlQuery removeQuery;
+    /* Statements for writing records, keyed by the comma separated list of fields they set. */
+    QHash<QString, QSqlQuery> upsertQueries;
+    /* Whether the SQLite version is new enough for "INSERT ... ON CONFLICT DO UPDATE". */
+    bool canUpsert;
+    /* Whether file names have a full text index, which needs SQLite's FTS5 module. */
+    bool hasNameIndex;
+
+    /* Values waiting to be written, keyed by dir & name. Committed all at once in a single transaction. */
+    QHash<QPair<QString, QString>, QVariantHash> pendingWrites;
+    QTimer* flushTimer;
+
+    QSqlDatabase database() const;
+
+    void setupDatabase();
+    /* Bring the table up to the current version. Stops at the first failure, inside a transaction that the caller rolls back. */
+    bool upgradeDatabase(const QSqlDatabase& db);
+    /* Create the full text index on names and the indexes for the search filters. Returns false on failure. */
+    bool setupSearch(const QSqlDatabase& db);
+    void clearQueries();
+
+    /* Get the (cached) statement that writes the given fields. */
+    QSqlQuery& upsertQuery(const QStringList& fields);
+
+public:
+    explicit DVMetadataService(const QString& path);
+
+    /* Load the records for every file in a dir, dirLoaded() is emitted when done. */
+    void loadDir(const QString& dir);
+    /* Load the record for a single file, recordLoaded() is emitted when done. */
+    void requestRecord(const QString& dir, const QString& name);
+
+    /* Set values for a file. Writes are queued and committed together. */
+    void writeRecord(const QString& dir, const QString& name, const QVariantHash& values);
+
+    /* Delete the records of files that are gone. */
+    void removeRecords(const QString& dir, const QStringList& names);
+
+    /* Find the files whose names contain every word in text (as the start of a word), searchFinished() is emitted with the id when done.
+     * Every filter is optional: "stereo" (bool), "stereoMode" (DVSourceMode), "surround" (bool), "video" (bool, false for images)
+     * and "modifiedAfter"/"modifiedBefore" (dates). With no text only the filters are used. */
+    void search(int id, const QString& text, const QVariantMap& filters);
+
+    /* Delete everything and start with an empty table. */
+    void reset();
+
+    /* Blocks until the record has been read. Only for the rare lookups that can't wait, never call from the render thread. */
+    QVariantHash readRecord(const QString& dir, const QString& name);
+    /* The same for every record in a dir, for background work that needs the records before it can go on. */
+    DVDirRecords readDir(const QString& dir);
+
+public slots:
+    /* Open the database. Must be run on the service thread, e.g. connected to QThread::started. */
+    void open();
+    /* Write anything pending and close the database. Must be run on the service thread before it stops. */
+    void close();
+
+private slots:
+    void loadDirImpl(const QString& dir);
+    DVDirRecords readDirImpl(const QString& dir);
+    void requestRecordImpl(const QString& dir, const QString& name);
+    void writeRecordImpl(const QString& dir, const QString& name, const QVariantHash& values);
+    void removeRecordsImpl(const QString& dir, const QStringList& names);
+    void searchImpl(int id, const QString& text, const QVariantMap& filters);
+    void resetImpl();
+    QVariantHash readRecordImpl(const QString& dir, const QString& name);
+
+    void flushWrites();
+
+signals:
+    void dirLoaded(const QString& dir, const DVDirRecords& records);
+    void recordLoaded(const QString& dir, const QString& name, const QVariantHash& record);
+    /* The records that matched, keyed by canonical path instead of name. */
+    void searchFinished(int id, const DVDirRecords& records);
+};
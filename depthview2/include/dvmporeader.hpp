@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QFile>
+#include <QImage>
+#include <QVector>
+
+/* Reads Multi-Picture Object files, as made by most stereo cameras: a JPEG for each eye, one after the other,
+ * with an index of where each one is in an MPF segment of the first.
+ * The file is memory mapped and each image is decoded straight from the mapping, so nothing is copied or read twice. */
+class DVMpoReader {
+    QFile file;
+    const uchar* data;
+    qint64 size;
+
+    struct Image {
+        qint64 offset;
+        qint64 length;
+    };
+    QVector<Image> images;
+
+    bool readIndex();
+
+public:
+    explicit DVMpoReader(const QString& fileName);
+    ~DVMpoReader();
+
+    /* Whether the file could be opened and has an index of at least two images. */
+    bool isValid() const;
+    int imageCount() const;
+
+    /* The compressed data of an image. Only valid for as long as the reader exists. */
+    QByteArray imageData(int index) const;
+
+    /* Decode the first two images on the calling thread and pack them side by side, left eye first.
+     * requestedSize is the size of the packed image, if it isn't valid the images are decoded at full size.
+     * If originalSize isn't null it is set to the full size of the packed image. */
+    QImage readSideBySide(const QSize& requestedSize = QSize(), QSize* originalSize = nullptr);
+};
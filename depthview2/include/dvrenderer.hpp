@@ -4,6 +4,7 @@
 #include <QSettings>
 #include <QOpenGLBuffer>
 #include "dvenums.hpp"
+#include "dvrenderstate.hpp"
 
 /* DepthView forward declarations. */
 class DVQmlCommunication;
@@ -42,6 +43,9 @@ public:
     /* Get the OpenGL textures for each eye. */
     virtual GLuint getInterfaceTexture(DVStereoEye::Type eye) const;
 
+    /* The state of the current file for the frame being drawn, taken once at the start of paintGL(). */
+    const DVRenderState& frameState() const;
+
     /* Returns the texture handle the current image / video, and sets left & right to where on the texture each eye is. */
     QSGTexture* getCurrentTexture(QRectF& left, QRectF& right);
 
@@ -86,6 +90,8 @@ protected:
     void preSync();
 
 private:
+    DVRenderState m_frameState;
+
     /* Shaders for built-in draw modes. */
     QOpenGLShaderProgram* shaderAnaglyph;
     QOpenGLShaderProgram* shaderSideBySide;
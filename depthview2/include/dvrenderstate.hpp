@@ -0,0 +1,44 @@
+#pragma once
+
+#include "dvenums.hpp"
+#include "dvfileentry.hpp"
+
+/* Everything about the current file that is needed to draw it.
+ * Published by DVFolderListing as a single packed integer whenever the file or its settings change,
+ * and read once per frame by the renderer, so that nothing on the render thread ever waits on a lock or the database. */
+struct DVRenderState {
+    DVSourceMode::Type stereoMode = DVSourceMode::Mono;
+    bool stereoSwap = false;
+    bool surround = false;
+
+    DVFileEntry::Type type = DVFileEntry::Other;
+
+    /* Not used for rendering, but it changes along with everything else so it is kept here too. -1 means the default track. */
+    int audioTrack = -1;
+
+    /* Layout of the packed value. */
+    static constexpr int modeMask = 0x7;
+    static constexpr int swapBit = 0x8;
+    static constexpr int surroundBit = 0x10;
+    static constexpr int typeShift = 5;
+    static constexpr int typeMask = 0x7;
+    /* The audio track is stored plus one, so that the default of -1 is zero. */
+    static constexpr int audioTrackShift = 8;
+
+    int pack() const {
+        return (stereoMode & modeMask) | (stereoSwap ? swapBit : 0) | (surround ? surroundBit : 0) |
+               ((type & typeMask) << typeShift) | ((audioTrack + 1) << audioTrackShift);
+    }
+
+    static DVRenderState unpack(int value) {
+        DVRenderState state;
+
+        state.stereoMode = DVSourceMode::Type(value & modeMask);
+        state.stereoSwap = value & swapBit;
+        state.surround = value & surroundBit;
+        state.type = DVFileEntry::Type((value >> typeShift) & typeMask);
+        state.audioTrack = (value >> audioTrackShift) - 1;
+
+        return state;
+    }
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QImage>
+#include "dvenums.hpp"
+
+/* Guesses whether media is side-by-side or top/bottom stereo from how alike the halves of its frames are.
+ * Each frame is reduced to a small grayscale sample, and the halves are compared by the sum of absolute differences,
+ * allowing for a few pixels of parallax between the views. The differences of several frames of a video are added up
+ * before deciding, and frames with too little detail to tell anything from (black frames, titles...) are skipped.
+ * The halves of a mono frame are often fairly alike too (sky above ground on both sides), so each split is also measured against
+ * how alike neighbouring quarters of the frame are. Those are two different parts of the same view in stereo media,
+ * but just as related as the halves in a mono frame. */
+class DVStereoDetector {
+    /* The average difference per pixel between the halves, summed over every usable frame. */
+    qreal sideBySideDifference;
+    qreal topBottomDifference;
+    /* The same for neighbouring quarters across and down, what the halves would differ by if the frame was mono. */
+    qreal sideBySideBaseline;
+    qreal topBottomBaseline;
+    int frames;
+
+public:
+    /* Detected layouts with less confidence than this aren't used. Mono frames rarely get past 0.3. */
+    static constexpr qreal minConfidence = 0.6;
+
+    /* Frames don't need to be decoded any larger than this, they only get scaled down further. */
+    static QSize frameSize() { return QSize(256, 256); }
+
+    DVStereoDetector();
+
+    void addFrame(const QImage& frame);
+
+    /* How many of the frames added had enough detail to be used. */
+    int usableFrames() const;
+
+    /* Returns false if no frame was usable, or if neither pair of halves is more alike than a mono frame's would be.
+     * mediaSize is the full size of the media, which tells full and anamorphic layouts apart. The confidence is 1 when one pair of halves
+     * matches exactly, and 0 when it differs as much as the other pair or the neighbouring quarters do. */
+    bool result(const QSize& mediaSize, DVSourceMode::Type& mode, qreal& confidence) const;
+
+    /* Sum of the absolute differences between two runs of bytes, with SSE2 or NEON when available. */
+    static quint32 sad(const uchar* a, const uchar* b, int length);
+};
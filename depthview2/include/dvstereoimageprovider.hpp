@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QQuickImageProvider>
+#include <QSharedPointer>
+
+class DVImagePrefetcher;
+
+/* Full size images for the viewer. MPO files are decoded into a side-by-side image, everything else is loaded normally.
+ * Full size requests go through the prefetcher, so the image will usually already be decoded by the time it's shown. */
+class DVStereoImageProvider : public QQuickImageProvider {
+    QSharedPointer<DVImagePrefetcher> prefetcher;
+
+public:
+    explicit DVStereoImageProvider(QSharedPointer<DVImagePrefetcher> p);
+
+    virtual QImage requestImage(const QString& id, QSize* size, const QSize& requestedSize) override;
+};
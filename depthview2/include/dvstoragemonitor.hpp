@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <memory>
+
+class QFile;
+class QTimer;
+
+/* Keeps track of the mounted volumes on its own thread, so that reading the list never blocks.
+ * The list is only refreshed when the mount table changes (or on a timer where that can't be watched),
+ * and each volume is given a limited time to respond so that a dead network share can't hold everything up. */
+class DVStorageMonitor : public QObject {
+    Q_OBJECT
+
+    mutable QMutex lock;
+    /* "<path>;<display name>;<size in bytes>" for each volume. */
+    QStringList m_paths;
+
+    /* Everything below is only ever used from the monitor thread. */
+
+    QFile* mountTable;
+    QTimer* pollTimer;
+
+    /* The result of checking a volume, shared with the thread doing the checking since that may outlive the monitor. */
+    struct VolumeStat;
+    /* Volumes that didn't respond in time, they aren't checked again until the last check returns. */
+    QHash<QString, std::shared_ptr<VolumeStat>> hungVolumes;
+
+    /* Get the display name and size of a volume, giving up after a timeout. Returns false if it timed out. */
+    bool statVolume(const QString& rootPath, QString& displayName, qint64& bytesTotal);
+
+    QStringList listVolumes();
+
+    /* Start watching for mounts/unmounts. Returns false if that isn't possible on this platform. */
+    bool watchMountTable();
+
+public:
+    DVStorageMonitor();
+
+    /* Safe to call from any thread. */
+    QStringList paths() const;
+
+public slots:
+    /* Start watching for changes and do the first refresh, must be called on the monitor thread. */
+    void start();
+    void refresh();
+
+signals:
+    void pathsChanged();
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+class QFileInfo;
+
+/* Stores thumbnails on disk so that they only ever have to be generated once, with the most recently used ones also kept in memory.
+ * Thumbnails are keyed by the file's path, size and modification time along with the requested size,
+ * so a file that changes simply gets a new entry. Safe to use from any thread.
+ * The files on disk are kept under a size limit by deleting the least recently used ones whenever what has been written goes over it. */
+class DVThumbnailCache {
+    const QString cacheDir;
+    const qint64 maxDiskBytes;
+
+    QMutex memoryLock;
+    /* Cost is in kilobytes. */
+    QCache<QByteArray, QImage> memoryCache;
+
+    QMutex diskLock;
+    /* Roughly how much the thumbnails on disk take up, counted when pruning and added to by insert(). */
+    qint64 diskBytes;
+    bool pruning;
+
+    QByteArray key(const QFileInfo& file, const QSize& requestedSize) const;
+    QString pathForKey(const QByteArray& key) const;
+
+    /* Delete the least recently used thumbnails until the rest are under the limit, run on prunePool. */
+    void prune();
+
+    /* Declared last so that it is destroyed first, which waits for a prune that is still going. */
+    QThreadPool prunePool;
+
+public:
+    /* maxBytes is the most the thumbnails on disk may take up, pruning is done in the background. */
+    DVThumbnailCache(const QString& dir, qint64 maxBytes);
+
+    /* Returns a null image if there is no thumbnail stored. If originalSize isn't null it is set to the size of the full image. */
+    QImage find(const QFileInfo& file, const QSize& requestedSize, QSize* originalSize = nullptr);
+
+    /* Store a thumbnail, both in memory and on disk. */
+    void insert(const QFileInfo& file, const QSize& requestedSize, const QImage& thumbnail, const QSize& originalSize);
+};
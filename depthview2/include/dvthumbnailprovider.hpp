@@ -1,30 +1,45 @@
 #pragma once
 
-#include <QQuickImageProvider>
+#include <QQuickAsyncImageProvider>
+#include <QSharedPointer>
+#include <QThreadPool>
 #include <QMutex>
-#include <QtAV/VideoFrameExtractor.h>
+#include <QList>
 
-class DVThumbnailProvider : public QObject, public QQuickImageProvider {
-    Q_OBJECT
+class DVThumbnailCache;
+class DVThumbnailResponse;
+class DVThumbnailViewport;
 
-    QImage image;
+/* Video thumbnails, extracted in parallel by a pool of workers.
+ * Ids are just the path, the viewport knows which rows are on screen so that their thumbnails can be done first. */
+class DVThumbnailProvider : public QQuickAsyncImageProvider {
+    QSharedPointer<DVThumbnailCache> cache;
+    QSharedPointer<DVThumbnailViewport> viewport;
 
-    QtAV::VideoFrameExtractor frameExtractor;
-    bool hadError;
+    /* The fraction of the way through each video to take the thumbnail from. */
+    const qreal thumbnailPosition;
 
-    QSize requestedFrameSize;
-    QSize originalFrameSize;
+    /* Separate from the global pool, because extraction blocks for a long time and shouldn't starve anything else. */
+    QThreadPool pool;
+    /* Checks the cache first, so thumbnails that are already stored never wait behind an extraction. */
+    QThreadPool cachePool;
 
-    QMutex waitReady;
+    /* Requests waiting for a free worker, oldest first. */
+    QMutex queueLock;
+    QList<DVThumbnailResponse*> queue;
 
-public:
-    DVThumbnailProvider();
+    /* Finish and remove any requests the engine cancelled. queueLock must be locked. */
+    void removeCancelledLocked();
 
-    virtual QQuickTextureFactory* requestTexture(const QString& id, QSize* size, const QSize& requestedSize) override;
+    /* Run on cachePool, finishes the request if it's cached and otherwise queues it for extraction. */
+    void lookup(DVThumbnailResponse* response);
+    /* Run on pool, takes the request with the highest priority from the queue. */
+    void processNext();
 
-    bool tryLoadThumbnail(int retries, const QString& id);
+public:
+    DVThumbnailProvider(const QSharedPointer<DVThumbnailCache>& thumbnailCache, const QSharedPointer<DVThumbnailViewport>& thumbnailViewport,
+                        qreal position);
+    ~DVThumbnailProvider();
 
-public slots:
-    void frameReceived(const QtAV::VideoFrame& frame);
-    void frameError();
+    virtual QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
 };
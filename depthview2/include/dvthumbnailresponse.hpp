@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QQuickImageResponse>
+#include <QImage>
+#include <QAtomicInt>
+
+/* A thumbnail that will be ready at some point in the future. Finished from whichever thread generated the image. */
+class DVThumbnailResponse : public QQuickImageResponse {
+    Q_OBJECT
+
+    const QString id;
+    const QSize requestedSize;
+
+    QAtomicInt cancelled;
+
+    QImage image;
+    QString error;
+
+public:
+    DVThumbnailResponse(const QString& id, const QSize& requestedSize);
+
+    const QString& fileId() const;
+    const QSize& size() const;
+
+    /* Whether the engine no longer wants the image, e.g. because the delegate was destroyed. */
+    bool isCancelled() const;
+
+    /* Set the result and tell the engine it's done. Must be called exactly once. */
+    void finish(const QImage& result, const QString& errorMessage = QString());
+
+    virtual QQuickTextureFactory* textureFactory() const override;
+    virtual QString errorString() const override;
+
+    /* Called by the engine from any thread. The request is skipped when it comes up in the queue. */
+    virtual void cancel() override;
+};
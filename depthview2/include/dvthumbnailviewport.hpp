@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QHash>
+
+/* Which rows of the file browser are on screen, used to decide which thumbnails to make first.
+ * Written from the GUI thread and read by the thumbnail workers, so everything is atomic or behind the lock. */
+class DVThumbnailViewport {
+    mutable QMutex lock;
+    /* The rows of the files within a screen of the view, thumbnails are asked for by path. */
+    QHash<QString, int> nearbyRows;
+
+    QAtomicInt firstVisible;
+    QAtomicInt lastVisible;
+    /* 1 when scrolling down, -1 when scrolling up. */
+    QAtomicInt direction;
+
+public:
+    enum Priority {
+        Visible,
+        /* The screen after the visible rows in the direction of scrolling. */
+        Ahead,
+        /* The screen before the visible rows. */
+        Behind,
+        Offscreen
+    };
+
+    DVThumbnailViewport();
+
+    /* nearby has the path of every row from one screen before first to one screen after last. */
+    void setVisibleRows(int first, int last, const QHash<QString, int>& nearby);
+
+    /* Rows that aren't known (-1) get the same priority as rows just ahead of the view. */
+    Priority priority(int row) const;
+    /* Files that aren't near the view are Offscreen, unless nothing is known about the view yet. */
+    Priority priority(const QString& path) const;
+};
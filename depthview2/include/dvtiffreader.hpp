@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QtEndian>
+
+/* Reads values from a TIFF structure (as used by EXIF and MPF) in whichever byte order it says it uses.
+ * Offsets are relative to the start of the TIFF header, and must be checked with contains() before reading. */
+class DVTiffReader {
+    const uchar* data;
+    quint32 size;
+    bool bigEndian;
+
+public:
+    /* Each IFD entry is a tag, a type, a count, and a value or offset. */
+    static constexpr quint32 ifdEntrySize = 12;
+
+    DVTiffReader(const uchar* d, quint32 s) : data(d), size(s), bigEndian(false) { }
+
+    /* Check the "II" (Intel, little endian) or "MM" (Motorola, big endian) header. */
+    bool readHeader() {
+        if (size < 8 || data[0] != data[1] || (data[0] != 'I' && data[0] != 'M'))
+            return false;
+
+        bigEndian = data[0] == 'M';
+        return true;
+    }
+
+    bool contains(quint32 offset, quint32 length) const {
+        return offset <= size && length <= size - offset;
+    }
+
+    quint16 u16(quint32 offset) const {
+        return bigEndian ? qFromBigEndian<quint16>(data + offset) : qFromLittleEndian<quint16>(data + offset);
+    }
+    quint32 u32(quint32 offset) const {
+        return bigEndian ? qFromBigEndian<quint32>(data + offset) : qFromLittleEndian<quint32>(data + offset);
+    }
+
+    /* The offset of the first IFD. */
+    quint32 firstIfd() const {
+        return u32(4);
+    }
+
+    /* Find an entry in the IFD at ifd, returning its offset or 0 if it isn't there. */
+    quint32 findEntry(quint32 ifd, quint16 tag) const {
+        if (!contains(ifd, 2)) return 0;
+
+        for (quint32 i = 0, count = u16(ifd); i < count; ++i) {
+            const quint32 entry = ifd + 2 + i * ifdEntrySize;
+            if (!contains(entry, ifdEntrySize)) break;
+
+            if (u16(entry) == tag) return entry;
+        }
+        return 0;
+    }
+
+    /* The offset of the IFD linked after the one at ifd, or 0 if there isn't one. */
+    quint32 nextIfd(quint32 ifd) const {
+        if (!contains(ifd, 2)) return 0;
+
+        const quint32 end = ifd + 2 + u16(ifd) * ifdEntrySize;
+        return contains(end, 4) ? u32(end) : 0;
+    }
+};
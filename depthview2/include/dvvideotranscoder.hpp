@@ -0,0 +1,37 @@
+#pragma once
+
+#include "dvcompositor.hpp"
+
+/* Converts a stereo video from one layout to another without a window or GL context, for the "--export" command line option.
+ * Decoding, converting (splitting into eyes, compositing with DVCompositor and converting to YUV) and encoding each run on their own
+ * thread, connected by short DVFrameQueues so that memory use stays the same however long the video is.
+ * Only the video stream is written, at a constant frame rate. Inputs with audio get a warning, since the output will be silent. */
+class DVVideoTranscoder {
+    DVCompositor compositor;
+    DVDrawMode::Type drawMode;
+    DVSourceMode::Type sourceMode;
+    bool swap;
+    QString codec;
+    int bitRate;
+
+public:
+    /* How many frames wait between each pair of stages. */
+    static constexpr int queueLength = 4;
+
+    DVVideoTranscoder();
+
+    /* The compositor's settings are copied. */
+    void setCompositor(const DVCompositor& c);
+    void setDrawMode(DVDrawMode::Type mode);
+    void setSourceLayout(DVSourceMode::Type mode, bool swapEyes);
+    /* Any encoder FFmpeg has, "libx264" by default. */
+    void setCodec(const QString& name);
+    /* In bits per second, 0 leaves it up to the encoder. */
+    void setBitRate(int bitsPerSecond);
+
+    /* Roughly the most memory a transcode of a video of frameSize uses, for the frames in the queues and being worked on. */
+    qint64 memoryEstimate(const QSize& frameSize) const;
+
+    /* Blocks until the whole video is done. The container is chosen by the suffix of output, which is only replaced once it's finished. */
+    bool transcode(const QString& input, const QString& output) const;
+};
@@ -108,9 +108,9 @@ ToolBar {
                             font: uiTextFont
 
                             checkable: true
-                            checked: FolderListing.currentFileStereoSwap !== FolderListing.currentFileIsStereoImage
+                            checked: FolderListing.currentFileStereoSwap !== FolderListing.currentFileDefaultSwap
 
-                            onCheckedChanged: FolderListing.currentFileStereoSwap = (checked !== FolderListing.currentFileIsStereoImage)
+                            onCheckedChanged: FolderListing.currentFileStereoSwap = (checked !== FolderListing.currentFileDefaultSwap)
                         }
 
                         MenuItem {
@@ -121,7 +121,7 @@ ToolBar {
                             checkable: true
                             checked: FolderListing.currentFileIsSurround
 
-                            /* Surround is not available for *.jps & *.pns files. */
+                            /* Surround is not available for stereo image files (*.jps, *.pns & *.mpo). */
                             visible: !FolderListing.currentFileIsStereoImage
                             height: visible ? implicitHeight : 0
 
@@ -131,7 +131,7 @@ ToolBar {
                         Connections {
                             target: FolderListing
 
-                            onCurrentFileStereoSwapChanged: stereoSwapMenuItem.checked = (FolderListing.currentFileStereoSwap !== FolderListing.currentFileIsStereoImage)
+                            onCurrentFileStereoSwapChanged: stereoSwapMenuItem.checked = (FolderListing.currentFileStereoSwap !== FolderListing.currentFileDefaultSwap)
                             onCurrentFileSurroundChanged: surroundMenuItem.checked = FolderListing.currentFileIsSurround
                         }
 
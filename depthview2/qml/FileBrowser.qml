@@ -61,7 +61,8 @@ Popup {
 
                         text: qsTr("Type: ") + fileTypeString + "<br>" +
                               /* Only show size when not a directory. */
-                              (fileIsDir ? fileSize + qsTr(" Files") : qsTr("Size: ") + FolderListing.bytesToString(fileSize)) + "<br>" +
+                              (fileIsDir ? (fileSize < 0 ? qsTr("Counting files...") : fileSize + qsTr(" Files")) :
+                                           qsTr("Size: ") + FolderListing.bytesToString(fileSize)) + "<br>" +
                               qsTr("Created: ") + fileCreated + "<br>" +
                               FolderListing.decodeURL(fileURL)
 
@@ -93,9 +94,10 @@ Popup {
 
                             imageMode: fileStereoMode
 
-                            /* If it is a directory use a thumbnail from qrc. Otherwise the file should be an image itself. */
+                            /* If it is a directory use a thumbnail from qrc. Otherwise use the (cached) thumbnail for the image or video. */
                             source: fileIsDir ? "qrc:/images/folder.pns" :
-                                    fileIsVideo ? "image://video/" + FolderListing.decodeURL(fileURL) : fileURL
+                                    fileIsVideo ? "image://video/" + FolderListing.decodeURL(fileURL) :
+                                                  "image://thumbnail/" + FolderListing.decodeURL(fileURL)
 
                             /* Images on the filesystem should be loaded asynchronously. */
                             asynchronous: !fileIsDir;
@@ -276,6 +278,30 @@ Popup {
                 /* So that it is the same as the delegate. */
                 cellWidth: root.cellWidth
                 cellHeight: root.cellHeight
+
+                /* Let the thumbnail providers know what is on screen. */
+                function updateVisibleRows() {
+                    var columns = Math.max(1, Math.floor(width / cellWidth))
+                    var first = Math.max(0, Math.floor((contentY - originY) / cellHeight) * columns)
+                    var last = Math.min(count, first + (Math.ceil(height / cellHeight) + 1) * columns) - 1
+
+                    FolderListing.setVisibleRows(first, last)
+                }
+
+                onContentYChanged: updateVisibleRows()
+                onWidthChanged: updateVisibleRows()
+                onHeightChanged: updateVisibleRows()
+                onCountChanged: updateVisibleRows()
+            }
+
+            /* Large directories are listed in the background, show that there is more to come. */
+            BusyIndicator {
+                anchors {
+                    right: parent.right
+                    bottom: parent.bottom
+                    margins: 16
+                }
+                running: FolderListing.scanning
             }
         }
 
@@ -330,6 +356,75 @@ Popup {
                     
                     text: FolderListing.decodeURL(FolderListing.currentDir)
                 }
+
+                TextField {
+                    id: searchText
+
+                    font: uiTextFont
+                    placeholderText: qsTr("Search Library")
+
+                    onAccepted: {
+                        if (text.length === 0) {
+                            FolderListing.clearSearch()
+                            return
+                        }
+
+                        /* Have the database apply the file filter too, so that the results aren't cut off before filtering. */
+                        var filters = {}
+
+                        if (FolderListing.fileFilter === FileFilter.StereoOnly)
+                            filters.stereo = true
+                        else if (FolderListing.fileFilter === FileFilter.SurroundOnly)
+                            filters.surround = true
+                        else if (FolderListing.fileFilter === FileFilter.VideoOnly)
+                            filters.video = true
+
+                        FolderListing.search(text, filters)
+                    }
+
+                    readOnly: Qt.platform.os === "android"
+                }
+
+                ToolButton {
+                    font: googleMaterialFont
+                    /* "close" */
+                    text: "\ue5cd"
+
+                    visible: FolderListing.searchResultsShown
+
+                    onClicked: {
+                        searchText.text = ""
+                        FolderListing.clearSearch()
+                    }
+                }
+
+                ComboBox {
+                    font: uiTextFont
+
+                    /* In the same order as the SortMode enum. */
+                    model: [qsTr("Name"), qsTr("Natural Name"), qsTr("Size"), qsTr("Date"), qsTr("Stereo Mode"), qsTr("Type")]
+                    currentIndex: FolderListing.sortMode
+
+                    onActivated: FolderListing.sortMode = index
+                }
+
+                ToolButton {
+                    font: googleMaterialFont
+                    /* "arrow_downward" or "arrow_upward" */
+                    text: FolderListing.sortDescending ? "\ue5db" : "\ue5d8"
+
+                    onClicked: FolderListing.sortDescending = !FolderListing.sortDescending
+                }
+
+                ComboBox {
+                    font: uiTextFont
+
+                    /* In the same order as the FileFilter enum. */
+                    model: [qsTr("All Files"), qsTr("3D Only"), qsTr("Surround Only"), qsTr("Videos Only")]
+                    currentIndex: FolderListing.fileFilter
+
+                    onActivated: FolderListing.fileFilter = index
+                }
                 
                 ToolButton {
                     font: googleMaterialFont
@@ -167,7 +167,10 @@ Item {
                 anchors.centerIn: parent
                 id: image
 
-                source: FolderListing.currentFileIsVideo ? "" : root.source
+                /* Loaded in C++ so that images decoded ahead of time can be used, and so that MPO files can be packed side by side.
+                 * With no file there is nothing to ask the provider for. */
+                source: FolderListing.currentFileIsVideo || root.source.toString() === "" ? "" :
+                        "image://stereo/" + FolderListing.decodeURL(root.source)
 
                 /* If zoom is negative we scale to fit, otherwise just use the value of zoom. */
                 scale: targetScale
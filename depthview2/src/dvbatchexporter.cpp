@@ -0,0 +1,289 @@
+#include "dvbatchexporter.hpp"
+#include "dvfunctiontask.hpp"
+#include "dvimageprefetcher.hpp"
+#include "dvkeyframeextractor.hpp"
+#include "dvlibraryindexer.hpp"
+#include "dvstereodetector.hpp"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QSet>
+
+namespace {
+/* The decoded frame, a converted copy of it, both eyes and the output are all around the size of the frame (more with squeezed
+ * sources, whose eyes are stretched back out). A rough upper bound, in frames of 32 bits per pixel. */
+constexpr int framesInMemory = 6;
+
+/* The same video types as DVFolderListing. */
+const QStringList videoSuffixes{"avi", "mp4", "m4v", "mkv", "ogv", "ogg", "webm", "flv", "3gp", "wmv", "mpg"};
+
+bool isMpo(const QString& file) {
+    return QFileInfo(file).suffix().compare("mpo", Qt::CaseInsensitive) == 0;
+}
+
+bool isVideo(const QString& file) {
+    return videoSuffixes.contains(QFileInfo(file).suffix(), Qt::CaseInsensitive);
+}
+
+/* Anything Qt can decode, plus the stereo formats that are either named differently or need packing (MPO), plus videos. */
+QStringList nameFilters() {
+    QStringList filters{"*.jps", "*.pns", "*.mpo"};
+
+    for (const QByteArray& format : QImageReader::supportedImageFormats())
+        filters << "*." + QString::fromLatin1(format);
+    for (const QString& suffix : videoSuffixes)
+        filters << "*." + suffix;
+
+    return filters;
+}
+
+bool detectedLayout(const DVStereoDetector& detector, const QSize& size, DVSourceMode::Type& mode) {
+    qreal confidence;
+
+    return detector.result(size, mode, confidence) && confidence >= DVStereoDetector::minConfidence;
+}
+}
+
+DVBatchExporter::DVBatchExporter(const Options& o) : options(o), memory(qMax(1, o.memoryMB)), exported(0), failed(0) {
+    pool.setMaxThreadCount(qMax(1, options.threads));
+
+    compositor.setGreyFactors(options.greyFacL, options.greyFacR);
+    compositor.setMirror(options.mirrorLeft, options.mirrorRight);
+    compositor.setAnamorphic(options.anamorphic);
+
+    transcoder.setCompositor(compositor);
+    transcoder.setDrawMode(options.drawMode);
+    transcoder.setCodec(options.videoCodec);
+    transcoder.setBitRate(options.videoBitRate);
+}
+
+DVBatchExporter::~DVBatchExporter() {
+    pool.clear();
+    pool.waitForDone();
+}
+
+int DVBatchExporter::run(const QStringList& inputs) {
+    QElapsedTimer timer;
+    timer.start();
+
+    const QList<QPair<QString, QString>> files = collectFiles(inputs);
+
+    qDebug("Exporting %i files as %s with %i threads (%s)...", files.size(), DVDrawMode::toString(options.drawMode),
+           pool.maxThreadCount(), DVCompositor::instructionSet());
+
+    /* The tasks only hold the file names, the images are limited by the memory budget instead. */
+    for (const auto& file : files)
+        pool.start(new DVFunctionTask([this, file]() { exportFile(file.first, file.second); }));
+
+    pool.waitForDone();
+
+    qDebug("Exported %i files in %.1f seconds, %i failed.", exported.load(), timer.elapsed() / 1000.0, failed.load());
+
+    return failed.load();
+}
+
+QList<QPair<QString, QString>> DVBatchExporter::collectFiles(const QStringList& inputs) {
+    QList<QPair<QString, QString>> files;
+    /* Files that differ only by suffix would be written to the same place. */
+    QSet<QString> outputs;
+
+    const QDir outputDir(options.outputDir);
+    const QStringList filters = nameFilters();
+
+    auto addFile = [&](const QString& input, const QString& relativePath) {
+        const QFileInfo relative(relativePath);
+        const QString output = QDir::cleanPath(outputDir.absoluteFilePath(relative.path() + '/' + relative.completeBaseName() + '.' +
+                                                                        (isVideo(input) ? options.videoFormat : options.format)));
+
+        if (output == QFileInfo(input).absoluteFilePath()) {
+            qWarning("Not exporting \"%s\" over itself!", qPrintable(input));
+            failed.ref();
+        } else if (outputs.contains(output)) {
+            qWarning("Not exporting \"%s\", another file is already being exported to \"%s\"!", qPrintable(input), qPrintable(output));
+            failed.ref();
+        } else {
+            outputs.insert(output);
+            files.append(qMakePair(input, output));
+        }
+    };
+
+    for (const QString& input : inputs) {
+        const QFileInfo info(input);
+
+        if (info.isDir()) {
+            const QDir dir(info.absoluteFilePath());
+            QDirIterator it(dir.absolutePath(), filters, QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+
+            while (it.hasNext()) {
+                const QString file = it.next();
+                addFile(file, dir.relativeFilePath(file));
+            }
+        } else if (info.isFile()) {
+            addFile(info.absoluteFilePath(), info.fileName());
+        } else {
+            qWarning("Can't export \"%s\", it doesn't exist!", qPrintable(input));
+            failed.ref();
+        }
+    }
+
+    return files;
+}
+
+void DVBatchExporter::exportFile(const QString& input, const QString& output) {
+    const bool video = isVideo(input);
+
+    QSize size;
+    QImage firstFrame;
+    qint64 bytes = 0;
+
+    if (video) {
+        /* The video's own size is wanted here, the frame is kept in case the layout has to be guessed. */
+        DVKeyframeExtractor extractor;
+        extractor.setReducedResolution(false);
+        firstFrame = extractor.extract(input, DVStereoDetector::frameSize(), &size);
+
+        if (size.isValid())
+            bytes = transcoder.memoryEstimate(size);
+    } else {
+        /* Only reads the header. MPO headers are of the first image, which is half of the packed frame. */
+        size = QImageReader(input).size();
+
+        if (isMpo(input))
+            size.rwidth() *= 2;
+
+        if (size.isValid())
+            bytes = qint64(size.width()) * size.height() * 4 * framesInMemory;
+    }
+
+    /* Files bigger than the whole budget get all of it, which means they run alone. */
+    const int cost = qBound(1, int(bytes / (1024 * 1024)) + 1, qMax(1, options.memoryMB));
+
+    memory.acquire(cost);
+    const bool success = video ? convertVideo(input, output, size, firstFrame) : convertImage(input, output);
+    memory.release(cost);
+
+    if (success)
+        exported.ref();
+    else
+        failed.ref();
+}
+
+bool DVBatchExporter::convertImage(const QString& input, const QString& output) const {
+    QImage left, right;
+
+    {
+        /* Warns by itself on failure. */
+        QImage frame = DVImagePrefetcher::decode(input, QSize());
+
+        if (frame.isNull())
+            return false;
+
+        DVSourceMode::Type mode;
+        bool swap;
+
+        if (!namedLayout(input, mode, swap)) {
+            DVStereoDetector detector;
+            detector.addFrame(frame.scaled(DVStereoDetector::frameSize(), Qt::KeepAspectRatio));
+
+            if (!detectedLayout(detector, frame.size(), mode)) {
+                qWarning("Can't tell the stereo layout of \"%s\", pass it with \"--source-mode\"!", qPrintable(input));
+                return false;
+            }
+        }
+
+        /* The eyes are copied out of one converted frame, so the compositor doesn't have to convert each of them. */
+        frame = frame.convertToFormat(QImage::Format_RGBA8888);
+
+        if (!DVCompositor::splitFrame(frame, mode, swap, left, right)) {
+            qWarning("Unable to split \"%s\" into its eyes!", qPrintable(input));
+            return false;
+        }
+    }
+
+    QImage image = compositor.compose(left, right, options.drawMode);
+
+    left = right = QImage();
+
+    if (image.isNull())
+        return false;
+
+    if (!QDir().mkpath(QFileInfo(output).absolutePath())) {
+        qWarning("Unable to create the dir for \"%s\"!", qPrintable(output));
+        return false;
+    }
+
+    /* Write to a temporary file first, so that a cancelled export never leaves half written images behind. */
+    QSaveFile file(output);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Unable to open \"%s\" to export to! %s", qPrintable(output), qPrintable(file.errorString()));
+        return false;
+    }
+
+    QImageWriter writer(&file, options.format);
+    writer.setQuality(options.quality);
+
+    if (!writer.write(image) || !file.commit()) {
+        qWarning("Unable to write \"%s\"! %s", qPrintable(output), qPrintable(writer.errorString()));
+        return false;
+    }
+
+    return true;
+}
+
+bool DVBatchExporter::convertVideo(const QString& input, const QString& output, const QSize& size, const QImage& firstFrame) const {
+    if (firstFrame.isNull()) {
+        qWarning("Unable to decode \"%s\"!", qPrintable(input));
+        return false;
+    }
+
+    DVSourceMode::Type mode;
+    bool swap;
+
+    if (!namedLayout(input, mode, swap)) {
+        /* The same frames the library indexer looks at, the first one was taken at 0.2. */
+        DVStereoDetector detector;
+        detector.addFrame(firstFrame);
+
+        DVKeyframeExtractor extractor;
+        for (const qreal position : {0.5, 0.8}) {
+            extractor.setPosition(position);
+            detector.addFrame(extractor.extract(input, DVStereoDetector::frameSize()));
+        }
+
+        if (!detectedLayout(detector, size, mode)) {
+            qWarning("Can't tell the stereo layout of \"%s\", pass it with \"--source-mode\"!", qPrintable(input));
+            return false;
+        }
+    }
+
+    if (!QDir().mkpath(QFileInfo(output).absolutePath())) {
+        qWarning("Unable to create the dir for \"%s\"!", qPrintable(output));
+        return false;
+    }
+
+    DVVideoTranscoder fileTranscoder = transcoder;
+    fileTranscoder.setSourceLayout(mode, swap);
+
+    return fileTranscoder.transcode(input, output);
+}
+
+bool DVBatchExporter::namedLayout(const QString& file, DVSourceMode::Type& mode, bool& swap) const {
+    const QString suffix = QFileInfo(file).suffix().toLower();
+
+    /* JPS and PNS are made for cross-eyed viewing so they are swapped by default, the same as in the viewer. */
+    swap = options.swap != (suffix == "jps" || suffix == "pns");
+
+    if (options.sourceMode != -1) {
+        mode = DVSourceMode::Type(options.sourceMode);
+        return true;
+    }
+
+    qreal confidence = 0.0;
+
+    return DVLibraryIndexer::layoutFromName(file, mode, confidence) && confidence >= DVStereoDetector::minConfidence;
+}
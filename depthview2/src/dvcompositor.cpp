@@ -0,0 +1,689 @@
+#include "dvcompositor.hpp"
+#include <QVector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DV_COMPOSITOR_SSE2
+/* GCC and Clang can build single functions for AVX2 without the rest of the program needing it, so those are chosen at runtime. */
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define DV_COMPOSITOR_AVX2
+#define DV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define DV_COMPOSITOR_NEON
+#endif
+
+namespace {
+/* The bytes of a pixel are R, G, B, A in memory, so where they are in a 32 bit word depends on the byte order.
+ * The vector kernels are only built for little endian CPUs. */
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+constexpr int redShift = 0;
+constexpr int greenShift = 8;
+constexpr int blueShift = 16;
+constexpr quint32 alphaMask = 0xff000000u;
+#else
+constexpr int redShift = 24;
+constexpr int greenShift = 16;
+constexpr int blueShift = 8;
+constexpr quint32 alphaMask = 0x000000ffu;
+#endif
+
+/* anaglyph.fsh's weights for grey (0.299, 0.587, 0.114) out of 256. */
+constexpr int greyWeightR = 77;
+constexpr int greyWeightG = 150;
+constexpr int greyWeightB = 29;
+
+/* Each kernel works on one row, and every one of them makes the output opaque. */
+typedef void (*CopyRow)(const quint32* in, quint32* out, int count);
+typedef void (*AverageRows)(const quint32* a, const quint32* b, quint32* out, int count);
+typedef void (*InterleaveRow)(const quint32* left, const quint32* right, quint32* out, int count, bool leftFirst);
+typedef void (*AnaglyphRow)(const quint32* left, const quint32* right, quint32* out, int count, int greyFacL, int greyFacR);
+
+struct Kernels {
+    const char* name;
+
+    /* out[i] = in[i] */
+    CopyRow copy;
+    /* out[i] = in[count - 1 - i] */
+    CopyRow reverse;
+    /* out[i] = the average of in[i * 2] and in[i * 2 + 1], what linear filtering samples half way between them. */
+    CopyRow squeeze;
+    /* out[i] = the average of a[i] and b[i] */
+    AverageRows average;
+    /* Every other pixel from each eye, starting with the left eye if leftFirst. */
+    InterleaveRow interleave;
+    /* The red of the left eye with the green and blue of the right eye, each turned partly grey. greyFac is out of 256. */
+    AnaglyphRow anaglyph;
+};
+
+/* Scalar kernels, these also finish off whatever is left over after the vector kernels. */
+
+int channel(quint32 pixel, int shift) {
+    return int(pixel >> shift) & 0xff;
+}
+
+int grey(quint32 pixel) {
+    return (greyWeightR * channel(pixel, redShift) + greyWeightG * channel(pixel, greenShift) + greyWeightB * channel(pixel, blueShift) + 128) >> 8;
+}
+
+/* anaglyph.fsh's "color * (1.0 - greyFac) + grey * greyFac" for one channel. */
+quint32 mixGrey(int value, int grey, int greyFac) {
+    return quint32((value * (256 - greyFac) + grey * greyFac + 128) >> 8);
+}
+
+/* The average of each byte rounded up, the same as _mm_avg_epu8(). */
+quint32 averagePixel(quint32 a, quint32 b) {
+    return ((a | b) - (((a ^ b) >> 1) & 0x7f7f7f7fu)) | alphaMask;
+}
+
+void copyScalar(const quint32* in, quint32* out, int count) {
+    for (int i = 0; i < count; ++i)
+        out[i] = in[i] | alphaMask;
+}
+
+void reverseScalar(const quint32* in, quint32* out, int count) {
+    for (int i = 0; i < count; ++i)
+        out[i] = in[count - 1 - i] | alphaMask;
+}
+
+void squeezeScalar(const quint32* in, quint32* out, int count) {
+    for (int i = 0; i < count; ++i)
+        out[i] = averagePixel(in[i * 2], in[i * 2 + 1]);
+}
+
+void averageScalar(const quint32* a, const quint32* b, quint32* out, int count) {
+    for (int i = 0; i < count; ++i)
+        out[i] = averagePixel(a[i], b[i]);
+}
+
+void interleaveScalar(const quint32* left, const quint32* right, quint32* out, int count, bool leftFirst) {
+    for (int i = 0; i < count; ++i)
+        out[i] = ((i % 2 == 0) == leftFirst ? left[i] : right[i]) | alphaMask;
+}
+
+void anaglyphScalar(const quint32* left, const quint32* right, quint32* out, int count, int greyFacL, int greyFacR) {
+    for (int i = 0; i < count; ++i) {
+        const quint32 l = left[i];
+        const quint32 r = right[i];
+        const int greyL = grey(l);
+        const int greyR = grey(r);
+
+        out[i] = mixGrey(channel(l, redShift), greyL, greyFacL) << redShift |
+                 mixGrey(channel(r, greenShift), greyR, greyFacR) << greenShift |
+                 mixGrey(channel(r, blueShift), greyR, greyFacR) << blueShift | alphaMask;
+    }
+}
+
+const Kernels scalarKernels = {"scalar", copyScalar, reverseScalar, squeezeScalar, averageScalar, interleaveScalar, anaglyphScalar};
+
+#if defined(DV_COMPOSITOR_SSE2)
+inline __m128i load(const quint32* in) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+}
+inline void store(quint32* out, __m128i value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), value);
+}
+
+void copySse2(const quint32* in, quint32* out, int count) {
+    const __m128i alpha = _mm_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        store(out + i, _mm_or_si128(load(in + i), alpha));
+
+    copyScalar(in + i, out + i, count - i);
+}
+
+void reverseSse2(const quint32* in, quint32* out, int count) {
+    const __m128i alpha = _mm_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        store(out + i, _mm_or_si128(_mm_shuffle_epi32(load(in + count - 4 - i), _MM_SHUFFLE(0, 1, 2, 3)), alpha));
+
+    reverseScalar(in, out + i, count - i);
+}
+
+void squeezeSse2(const quint32* in, quint32* out, int count) {
+    const __m128i alpha = _mm_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 a = _mm_castsi128_ps(load(in + i * 2));
+        const __m128 b = _mm_castsi128_ps(load(in + i * 2 + 4));
+
+        /* Split into the even and odd pixels. */
+        const __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        store(out + i, _mm_or_si128(_mm_avg_epu8(even, odd), alpha));
+    }
+
+    squeezeScalar(in + i * 2, out + i, count - i);
+}
+
+void averageSse2(const quint32* a, const quint32* b, quint32* out, int count) {
+    const __m128i alpha = _mm_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        store(out + i, _mm_or_si128(_mm_avg_epu8(load(a + i), load(b + i)), alpha));
+
+    averageScalar(a + i, b + i, out + i, count - i);
+}
+
+void interleaveSse2(const quint32* left, const quint32* right, quint32* out, int count, bool leftFirst) {
+    const __m128i alpha = _mm_set1_epi32(int(alphaMask));
+    /* All ones in the lanes taken from the left eye. */
+    const __m128i mask = leftFirst ? _mm_set_epi32(0, -1, 0, -1) : _mm_set_epi32(-1, 0, -1, 0);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        store(out + i, _mm_or_si128(_mm_or_si128(_mm_and_si128(mask, load(left + i)), _mm_andnot_si128(mask, load(right + i))), alpha));
+
+    /* i is even, so the pattern carries on the same. */
+    interleaveScalar(left + i, right + i, out + i, count - i, leftFirst);
+}
+
+/* Everything fits in 16 bits, so with a zero upper half in every 32 bit lane _mm_madd_epi16() is a 32 bit multiply. */
+inline __m128i greySse2(__m128i r, __m128i g, __m128i b) {
+    const __m128i products = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(r, _mm_set1_epi32(greyWeightR)), _mm_madd_epi16(g, _mm_set1_epi32(greyWeightG))),
+                                           _mm_madd_epi16(b, _mm_set1_epi32(greyWeightB)));
+
+    return _mm_srli_epi32(_mm_add_epi32(products, _mm_set1_epi32(128)), 8);
+}
+inline __m128i mixGreySse2(__m128i value, __m128i grey, int greyFac) {
+    const __m128i mixed = _mm_add_epi32(_mm_madd_epi16(value, _mm_set1_epi32(256 - greyFac)), _mm_madd_epi16(grey, _mm_set1_epi32(greyFac)));
+
+    return _mm_srli_epi32(_mm_add_epi32(mixed, _mm_set1_epi32(128)), 8);
+}
+
+void anaglyphSse2(const quint32* left, const quint32* right, quint32* out, int count, int greyFacL, int greyFacR) {
+    const __m128i alpha = _mm_set1_epi32(int(alphaMask));
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i l = load(left + i);
+        const __m128i r = load(right + i);
+
+        /* One channel of each pixel in each lane. */
+        const __m128i lr = _mm_and_si128(l, byteMask);
+        const __m128i lg = _mm_and_si128(_mm_srli_epi32(l, greenShift), byteMask);
+        const __m128i lb = _mm_and_si128(_mm_srli_epi32(l, blueShift), byteMask);
+        const __m128i rr = _mm_and_si128(r, byteMask);
+        const __m128i rg = _mm_and_si128(_mm_srli_epi32(r, greenShift), byteMask);
+        const __m128i rb = _mm_and_si128(_mm_srli_epi32(r, blueShift), byteMask);
+
+        const __m128i greyL = greySse2(lr, lg, lb);
+        const __m128i greyR = greySse2(rr, rg, rb);
+
+        const __m128i red = mixGreySse2(lr, greyL, greyFacL);
+        const __m128i green = mixGreySse2(rg, greyR, greyFacR);
+        const __m128i blue = mixGreySse2(rb, greyR, greyFacR);
+
+        store(out + i, _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, greenShift)), _mm_or_si128(_mm_slli_epi32(blue, blueShift), alpha)));
+    }
+
+    anaglyphScalar(left + i, right + i, out + i, count - i, greyFacL, greyFacR);
+}
+
+const Kernels sse2Kernels = {"SSE2", copySse2, reverseSse2, squeezeSse2, averageSse2, interleaveSse2, anaglyphSse2};
+#endif
+
+#if defined(DV_COMPOSITOR_AVX2)
+DV_TARGET_AVX2 inline __m256i load256(const quint32* in) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+}
+DV_TARGET_AVX2 inline void store256(quint32* out, __m256i value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), value);
+}
+
+DV_TARGET_AVX2 void copyAvx2(const quint32* in, quint32* out, int count) {
+    const __m256i alpha = _mm256_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        store256(out + i, _mm256_or_si256(load256(in + i), alpha));
+
+    copyScalar(in + i, out + i, count - i);
+}
+
+DV_TARGET_AVX2 void reverseAvx2(const quint32* in, quint32* out, int count) {
+    const __m256i alpha = _mm256_set1_epi32(int(alphaMask));
+    const __m256i reversed = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        store256(out + i, _mm256_or_si256(_mm256_permutevar8x32_epi32(load256(in + count - 8 - i), reversed), alpha));
+
+    reverseScalar(in, out + i, count - i);
+}
+
+DV_TARGET_AVX2 void squeezeAvx2(const quint32* in, quint32* out, int count) {
+    const __m256i alpha = _mm256_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 a = _mm256_castsi256_ps(load256(in + i * 2));
+        const __m256 b = _mm256_castsi256_ps(load256(in + i * 2 + 8));
+
+        /* The shuffle stays within each 128 bit half, so the 64 bit pairs need to be put back in order after. */
+        const __m256i even = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i odd = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+
+        store256(out + i, _mm256_or_si256(_mm256_avg_epu8(even, odd), alpha));
+    }
+
+    squeezeScalar(in + i * 2, out + i, count - i);
+}
+
+DV_TARGET_AVX2 void averageAvx2(const quint32* a, const quint32* b, quint32* out, int count) {
+    const __m256i alpha = _mm256_set1_epi32(int(alphaMask));
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        store256(out + i, _mm256_or_si256(_mm256_avg_epu8(load256(a + i), load256(b + i)), alpha));
+
+    averageScalar(a + i, b + i, out + i, count - i);
+}
+
+DV_TARGET_AVX2 void interleaveAvx2(const quint32* left, const quint32* right, quint32* out, int count, bool leftFirst) {
+    const __m256i alpha = _mm256_set1_epi32(int(alphaMask));
+    const __m256i mask = leftFirst ? _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1) : _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        store256(out + i, _mm256_or_si256(_mm256_blendv_epi8(load256(right + i), load256(left + i), mask), alpha));
+
+    interleaveScalar(left + i, right + i, out + i, count - i, leftFirst);
+}
+
+/* AVX2 has a real 32 bit multiply, and everything fits in 32 bits. */
+DV_TARGET_AVX2 inline __m256i greyAvx2(__m256i r, __m256i g, __m256i b) {
+    const __m256i products = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(greyWeightR)),
+                                                                _mm256_mullo_epi32(g, _mm256_set1_epi32(greyWeightG))),
+                                              _mm256_mullo_epi32(b, _mm256_set1_epi32(greyWeightB)));
+
+    return _mm256_srli_epi32(_mm256_add_epi32(products, _mm256_set1_epi32(128)), 8);
+}
+DV_TARGET_AVX2 inline __m256i mixGreyAvx2(__m256i value, __m256i grey, int greyFac) {
+    const __m256i mixed = _mm256_add_epi32(_mm256_mullo_epi32(value, _mm256_set1_epi32(256 - greyFac)), _mm256_mullo_epi32(grey, _mm256_set1_epi32(greyFac)));
+
+    return _mm256_srli_epi32(_mm256_add_epi32(mixed, _mm256_set1_epi32(128)), 8);
+}
+
+DV_TARGET_AVX2 void anaglyphAvx2(const quint32* left, const quint32* right, quint32* out, int count, int greyFacL, int greyFacR) {
+    const __m256i alpha = _mm256_set1_epi32(int(alphaMask));
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i l = load256(left + i);
+        const __m256i r = load256(right + i);
+
+        const __m256i lr = _mm256_and_si256(l, byteMask);
+        const __m256i lg = _mm256_and_si256(_mm256_srli_epi32(l, greenShift), byteMask);
+        const __m256i lb = _mm256_and_si256(_mm256_srli_epi32(l, blueShift), byteMask);
+        const __m256i rr = _mm256_and_si256(r, byteMask);
+        const __m256i rg = _mm256_and_si256(_mm256_srli_epi32(r, greenShift), byteMask);
+        const __m256i rb = _mm256_and_si256(_mm256_srli_epi32(r, blueShift), byteMask);
+
+        const __m256i greyL = greyAvx2(lr, lg, lb);
+        const __m256i greyR = greyAvx2(rr, rg, rb);
+
+        const __m256i red = mixGreyAvx2(lr, greyL, greyFacL);
+        const __m256i green = mixGreyAvx2(rg, greyR, greyFacR);
+        const __m256i blue = mixGreyAvx2(rb, greyR, greyFacR);
+
+        store256(out + i, _mm256_or_si256(_mm256_or_si256(red, _mm256_slli_epi32(green, greenShift)),
+                                          _mm256_or_si256(_mm256_slli_epi32(blue, blueShift), alpha)));
+    }
+
+    anaglyphScalar(left + i, right + i, out + i, count - i, greyFacL, greyFacR);
+}
+
+const Kernels avx2Kernels = {"AVX2", copyAvx2, reverseAvx2, squeezeAvx2, averageAvx2, interleaveAvx2, anaglyphAvx2};
+#endif
+
+#if defined(DV_COMPOSITOR_NEON)
+void copyNeon(const quint32* in, quint32* out, int count) {
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_u32(out + i, vorrq_u32(vld1q_u32(in + i), alpha));
+
+    copyScalar(in + i, out + i, count - i);
+}
+
+void reverseNeon(const quint32* in, quint32* out, int count) {
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        /* Swap within each half, then swap the halves. */
+        const uint32x4_t swapped = vrev64q_u32(vld1q_u32(in + count - 4 - i));
+        vst1q_u32(out + i, vorrq_u32(vcombine_u32(vget_high_u32(swapped), vget_low_u32(swapped)), alpha));
+    }
+
+    reverseScalar(in, out + i, count - i);
+}
+
+void squeezeNeon(const quint32* in, quint32* out, int count) {
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        /* Loads the even and odd pixels separately. */
+        const uint32x4x2_t pixels = vld2q_u32(in + i * 2);
+        const uint8x16_t average = vrhaddq_u8(vreinterpretq_u8_u32(pixels.val[0]), vreinterpretq_u8_u32(pixels.val[1]));
+
+        vst1q_u32(out + i, vorrq_u32(vreinterpretq_u32_u8(average), alpha));
+    }
+
+    squeezeScalar(in + i * 2, out + i, count - i);
+}
+
+void averageNeon(const quint32* a, const quint32* b, quint32* out, int count) {
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint8x16_t average = vrhaddq_u8(vreinterpretq_u8_u32(vld1q_u32(a + i)), vreinterpretq_u8_u32(vld1q_u32(b + i)));
+        vst1q_u32(out + i, vorrq_u32(vreinterpretq_u32_u8(average), alpha));
+    }
+
+    averageScalar(a + i, b + i, out + i, count - i);
+}
+
+void interleaveNeon(const quint32* left, const quint32* right, quint32* out, int count, bool leftFirst) {
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+    const quint32 first = leftFirst ? ~0u : 0u;
+    const quint32 pattern[] = {first, ~first, first, ~first};
+    const uint32x4_t mask = vld1q_u32(pattern);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_u32(out + i, vorrq_u32(vbslq_u32(mask, vld1q_u32(left + i), vld1q_u32(right + i)), alpha));
+
+    interleaveScalar(left + i, right + i, out + i, count - i, leftFirst);
+}
+
+inline uint32x4_t greyNeon(uint32x4_t r, uint32x4_t g, uint32x4_t b) {
+    uint32x4_t products = vmulq_n_u32(r, greyWeightR);
+    products = vmlaq_n_u32(products, g, greyWeightG);
+    products = vmlaq_n_u32(products, b, greyWeightB);
+
+    return vshrq_n_u32(vaddq_u32(products, vdupq_n_u32(128)), 8);
+}
+inline uint32x4_t mixGreyNeon(uint32x4_t value, uint32x4_t grey, int greyFac) {
+    const uint32x4_t mixed = vmlaq_n_u32(vmulq_n_u32(value, quint32(256 - greyFac)), grey, quint32(greyFac));
+
+    return vshrq_n_u32(vaddq_u32(mixed, vdupq_n_u32(128)), 8);
+}
+
+void anaglyphNeon(const quint32* left, const quint32* right, quint32* out, int count, int greyFacL, int greyFacR) {
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+    const uint32x4_t byteMask = vdupq_n_u32(0xff);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t l = vld1q_u32(left + i);
+        const uint32x4_t r = vld1q_u32(right + i);
+
+        const uint32x4_t lr = vandq_u32(l, byteMask);
+        const uint32x4_t lg = vandq_u32(vshrq_n_u32(l, greenShift), byteMask);
+        const uint32x4_t lb = vandq_u32(vshrq_n_u32(l, blueShift), byteMask);
+        const uint32x4_t rr = vandq_u32(r, byteMask);
+        const uint32x4_t rg = vandq_u32(vshrq_n_u32(r, greenShift), byteMask);
+        const uint32x4_t rb = vandq_u32(vshrq_n_u32(r, blueShift), byteMask);
+
+        const uint32x4_t greyL = greyNeon(lr, lg, lb);
+        const uint32x4_t greyR = greyNeon(rr, rg, rb);
+
+        const uint32x4_t red = mixGreyNeon(lr, greyL, greyFacL);
+        const uint32x4_t green = mixGreyNeon(rg, greyR, greyFacR);
+        const uint32x4_t blue = mixGreyNeon(rb, greyR, greyFacR);
+
+        vst1q_u32(out + i, vorrq_u32(vorrq_u32(red, vshlq_n_u32(green, greenShift)), vorrq_u32(vshlq_n_u32(blue, blueShift), alpha)));
+    }
+
+    anaglyphScalar(left + i, right + i, out + i, count - i, greyFacL, greyFacR);
+}
+
+const Kernels neonKernels = {"NEON", copyNeon, reverseNeon, squeezeNeon, averageNeon, interleaveNeon, anaglyphNeon};
+#endif
+
+/* The fastest kernels this CPU can run. */
+const Kernels& vectorKernels() {
+#if defined(DV_COMPOSITOR_AVX2)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (hasAvx2) return avx2Kernels;
+#endif
+#if defined(DV_COMPOSITOR_SSE2)
+    return sse2Kernels;
+#elif defined(DV_COMPOSITOR_NEON)
+    return neonKernels;
+#else
+    return scalarKernels;
+#endif
+}
+
+/* GLSL's mod(x, 2.0), which is never negative. */
+int parity(int value) {
+    return value & 1;
+}
+
+int fixedGreyFac(qreal greyFac) {
+    return qBound(0, qRound(greyFac * 256), 256);
+}
+
+const quint32* constRow(const QImage& image, int y) {
+    return reinterpret_cast<const quint32*>(image.constScanLine(y));
+}
+}
+
+DVCompositor::DVCompositor() : greyFacL(0.0), greyFacR(0.0), mirrorL(false), mirrorR(false), anamorphic(false), vectorized(true) { }
+
+void DVCompositor::setGreyFactors(qreal left, qreal right) {
+    greyFacL = left;
+    greyFacR = right;
+}
+
+void DVCompositor::setMirror(bool left, bool right) {
+    mirrorL = left;
+    mirrorR = right;
+}
+
+void DVCompositor::setAnamorphic(bool squeeze) {
+    anamorphic = squeeze;
+}
+
+void DVCompositor::setScreenOrigin(const QPoint& origin) {
+    screenOrigin = origin;
+}
+
+void DVCompositor::setVectorized(bool enabled) {
+    vectorized = enabled;
+}
+
+const char* DVCompositor::instructionSet() {
+    return vectorKernels().name;
+}
+
+bool DVCompositor::splitFrame(const QImage& frame, DVSourceMode::Type mode, bool swap, QImage& left, QImage& right) {
+    if (frame.isNull()) return false;
+
+    QRect first = frame.rect();
+    QRect second = first;
+    QSize eyeSize = frame.size();
+
+    switch (mode) {
+    case DVSourceMode::SideBySide:
+    case DVSourceMode::SideBySideAnamorphic:
+        first.setWidth(frame.width() / 2);
+        second = first.translated(first.width(), 0);
+        eyeSize = first.size();
+
+        if (mode == DVSourceMode::SideBySideAnamorphic)
+            eyeSize.rwidth() *= 2;
+        break;
+    case DVSourceMode::TopBottom:
+    case DVSourceMode::TopBottomAnamorphic:
+        first.setHeight(frame.height() / 2);
+        second = first.translated(0, first.height());
+        eyeSize = first.size();
+
+        if (mode == DVSourceMode::TopBottomAnamorphic)
+            eyeSize.rheight() *= 2;
+        break;
+    case DVSourceMode::Mono:
+        left = right = frame;
+        return true;
+    default:
+        qWarning("Source mode %i can't be split!", int(mode));
+        return false;
+    }
+
+    if (first.isEmpty()) return false;
+
+    left = frame.copy(swap ? second : first);
+    right = frame.copy(swap ? first : second);
+
+    if (left.size() != eyeSize) {
+        left = left.scaled(eyeSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        right = right.scaled(eyeSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    return true;
+}
+
+QSize DVCompositor::outputSize(const QSize& eyeSize, DVDrawMode::Type mode) const {
+    switch (mode) {
+    case DVDrawMode::SideBySide:
+        /* Squeezing an odd width leaves out the last column. */
+        return QSize(anamorphic ? eyeSize.width() / 2 * 2 : eyeSize.width() * 2, eyeSize.height());
+    case DVDrawMode::TopBottom:
+        return QSize(eyeSize.width(), anamorphic ? eyeSize.height() / 2 * 2 : eyeSize.height() * 2);
+    default:
+        return eyeSize;
+    }
+}
+
+QImage DVCompositor::compose(const QImage& leftImage, const QImage& rightImage, DVDrawMode::Type mode) const {
+    if (leftImage.isNull() || rightImage.isNull())
+        return QImage();
+
+    if (leftImage.size() != rightImage.size()) {
+        qWarning("Can't composite eyes of different sizes! (%ix%i and %ix%i)",
+                 leftImage.width(), leftImage.height(), rightImage.width(), rightImage.height());
+        return QImage();
+    }
+
+    if (mode < DVDrawMode::Anaglyph || mode > DVDrawMode::Mono) {
+        qWarning("Draw mode %i can't be composited!", int(mode));
+        return QImage();
+    }
+
+    /* These don't copy anything if the images are already in the right format. */
+    const QImage left = leftImage.convertToFormat(QImage::Format_RGBA8888);
+    const QImage right = rightImage.convertToFormat(QImage::Format_RGBA8888);
+
+    const int width = left.width();
+    const int height = left.height();
+
+    QImage output(outputSize(left.size(), mode), QImage::Format_RGBA8888);
+
+    if (output.isNull()) {
+        qWarning("Unable to allocate a %ix%i image to composite into!", outputSize(left.size(), mode).width(), outputSize(left.size(), mode).height());
+        return output;
+    }
+
+    const Kernels& kernels = vectorized ? vectorKernels() : scalarKernels;
+
+    auto outputRow = [&output](int y) { return reinterpret_cast<quint32*>(output.scanLine(y)); };
+
+    switch (mode) {
+    case DVDrawMode::Anaglyph: {
+        const int facL = fixedGreyFac(greyFacL);
+        const int facR = fixedGreyFac(greyFacR);
+
+        for (int y = 0; y < height; ++y)
+            kernels.anaglyph(constRow(left, y), constRow(right, y), outputRow(y), width, facL, facR);
+        break;
+    }
+    case DVDrawMode::SideBySide: {
+        const int eyeWidth = output.width() / 2;
+
+        /* Mirrored eyes are flipped before they're squeezed. */
+        QVector<quint32> flipped(anamorphic && (mirrorL || mirrorR) ? width : 0);
+
+        auto putEye = [&](const quint32* in, quint32* out, bool mirror) {
+            if (!anamorphic) {
+                (mirror ? kernels.reverse : kernels.copy)(in, out, width);
+            } else if (mirror) {
+                kernels.reverse(in, flipped.data(), width);
+                kernels.squeeze(flipped.constData(), out, eyeWidth);
+            } else {
+                kernels.squeeze(in, out, eyeWidth);
+            }
+        };
+
+        for (int y = 0; y < height; ++y) {
+            quint32* out = outputRow(y);
+
+            putEye(constRow(left, y), out, mirrorL);
+            putEye(constRow(right, y), out + eyeWidth, mirrorR);
+        }
+        break;
+    }
+    case DVDrawMode::TopBottom: {
+        const int eyeHeight = output.height() / 2;
+
+        auto putRow = [&](const QImage& eye, int y, quint32* out, bool mirror) {
+            if (mirror) y = eyeHeight - 1 - y;
+
+            if (anamorphic)
+                kernels.average(constRow(eye, y * 2), constRow(eye, y * 2 + 1), out, width);
+            else
+                kernels.copy(constRow(eye, y), out, width);
+        };
+
+        /* topbottom.fsh puts the left eye at the bottom of the window, GL counts up from there. */
+        for (int y = 0; y < eyeHeight; ++y) {
+            putRow(right, y, outputRow(y), mirrorR);
+            putRow(left, y, outputRow(eyeHeight + y), mirrorL);
+        }
+        break;
+    }
+    case DVDrawMode::InterlacedH:
+    case DVDrawMode::InterlacedV:
+    case DVDrawMode::Checkerboard: {
+        const bool horizontal = mode != DVDrawMode::InterlacedV;
+        const bool vertical = mode != DVDrawMode::InterlacedH;
+
+        for (int y = 0; y < height; ++y) {
+            /* interlaced.fsh flips GL's bottom up rows, which makes the top row of the window row 1 rather than 0. */
+            const int screenY = parity(y + 1 + screenOrigin.y());
+
+            if (vertical)
+                kernels.interleave(constRow(left, y), constRow(right, y), outputRow(y), width,
+                                   parity(screenOrigin.x()) == (horizontal ? screenY : 0));
+            else
+                kernels.copy(constRow(screenY == 0 ? left : right, y), outputRow(y), width);
+        }
+        break;
+    }
+    case DVDrawMode::Mono:
+        for (int y = 0; y < height; ++y)
+            kernels.copy(constRow(left, y), outputRow(y), width);
+        break;
+    default:
+        break;
+    }
+
+    return output;
+}
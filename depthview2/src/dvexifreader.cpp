@@ -0,0 +1,78 @@
+#include "dvexifreader.hpp"
+#include "dvtiffreader.hpp"
+#include <QFile>
+#include <QtEndian>
+
+namespace {
+/* JPEG markers. */
+constexpr uchar markerStart = 0xff;
+constexpr uchar markerSOI = 0xd8;
+constexpr uchar markerAPP1 = 0xe1;
+constexpr uchar markerSOS = 0xda;
+
+/* TIFF tags in IFD1 giving the position and size of the thumbnail. */
+constexpr quint16 tagThumbnailOffset = 0x0201;
+constexpr quint16 tagThumbnailLength = 0x0202;
+
+/* Find the contents of the EXIF APP1 segment, starting at the TIFF header. */
+QByteArray readExifSegment(QFile& file) {
+    uchar header[2];
+
+    if (file.read(reinterpret_cast<char*>(header), 2) != 2 || header[0] != markerStart || header[1] != markerSOI)
+        return QByteArray();
+
+    forever {
+        uchar marker[4];
+        if (file.read(reinterpret_cast<char*>(marker), 4) != 4 || marker[0] != markerStart)
+            return QByteArray();
+
+        /* The length includes its own two bytes. */
+        const int length = qFromBigEndian<quint16>(marker + 2) - 2;
+
+        /* Image data starts after this, there won't be any more metadata. */
+        if (marker[1] == markerSOS || length < 0)
+            return QByteArray();
+
+        if (marker[1] == markerAPP1) {
+            const QByteArray segment = file.read(length);
+
+            if (segment.startsWith(QByteArray("Exif\0\0", 6)))
+                return segment.mid(6);
+        } else if (!file.seek(file.pos() + length)) {
+            return QByteArray();
+        }
+    }
+}
+}
+
+QByteArray DVExifReader::jpegThumbnail(const QString& fileName) {
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    const QByteArray tiff = readExifSegment(file);
+
+    DVTiffReader data(reinterpret_cast<const uchar*>(tiff.constData()), quint32(tiff.size()));
+
+    if (!data.readHeader())
+        return QByteArray();
+
+    /* IFD0 describes the main image, the thumbnail is in the IFD linked after it. */
+    const quint32 ifd1 = data.nextIfd(data.firstIfd());
+    if (ifd1 == 0)
+        return QByteArray();
+
+    const quint32 offsetEntry = data.findEntry(ifd1, tagThumbnailOffset);
+    const quint32 lengthEntry = data.findEntry(ifd1, tagThumbnailLength);
+    if (offsetEntry == 0 || lengthEntry == 0)
+        return QByteArray();
+
+    const quint32 offset = data.u32(offsetEntry + 8);
+    const quint32 length = data.u32(lengthEntry + 8);
+
+    if (length == 0 || !data.contains(offset, length))
+        return QByteArray();
+
+    return tiff.mid(int(offset), int(length));
+}
@@ -1,29 +1,106 @@
 #include "dvfolderlisting.hpp"
+#include "dvfolderscanner.hpp"
+#include "dvstoragemonitor.hpp"
+#include "dvlibraryindexer.hpp"
+#include "dvstereodetector.hpp"
+#include "dvthumbnailviewport.hpp"
 #include <QApplication>
-#include <QStorageInfo>
 #include <QSettings>
 #include <QDateTime>
-#include <QSqlQuery>
-#include <QSqlRecord>
-#include <QSqlError>
-#include <QMutexLocker>
+#include <algorithm>
+
+namespace {
+/* Get the dir and name a file is stored under in the database. Returns false if the file doesn't exist. */
+bool fileDatabaseKey(const QFileInfo& file, QString& dir, QString& name) {
+    QFileInfo canonical(file.canonicalFilePath());
+
+    /* An empty canonical path means the file doesn't exist. */
+    if (canonical.filePath().isEmpty())
+        return false;
+
+    dir = canonical.absolutePath();
+    name = canonical.fileName();
+
+    return true;
+}
+
+/* The key prefix for files in a dir, with a trailing slash (the root dir already has one). */
+QString dirKey(const QString& dir) {
+    return dir.endsWith('/') ? dir : dir + '/';
+}
+
+/* Each separate run of rows inserted or removed means moving everything after it, past this many a reset is cheaper. */
+constexpr int maxRowRuns = 32;
+
+/* Compare names with runs of digits compared by their value, so that "img2" comes before "img10". */
+int naturalCompare(const QString& a, const QString& b) {
+    int i = 0;
+    int j = 0;
+
+    while (i < a.size() && j < b.size()) {
+        if (a[i].isDigit() && b[j].isDigit()) {
+            int endA = i, endB = j;
+            while (endA < a.size() && a[endA].isDigit()) ++endA;
+            while (endB < b.size() && b[endB].isDigit()) ++endB;
+
+            /* Leading zeros don't change the value. */
+            while (i < endA - 1 && a[i] == '0') ++i;
+            while (j < endB - 1 && b[j] == '0') ++j;
+
+            /* A longer number is a larger one, otherwise the first digit that differs decides. */
+            if (endA - i != endB - j)
+                return (endA - i) - (endB - j);
+
+            for (; i < endA; ++i, ++j)
+                if (a[i] != b[j])
+                    return a[i].unicode() - b[j].unicode();
+        } else {
+            const QChar x = a[i].toCaseFolded();
+            const QChar y = b[j].toCaseFolded();
+
+            if (x != y)
+                return x.unicode() - y.unicode();
+
+            ++i;
+            ++j;
+        }
+    }
+
+    /* Whichever has something left over is the longer one. */
+    return int(i < a.size()) - int(j < b.size());
+}
+}
 
 DVFolderListing::DVFolderListing(QObject* parent, QSettings& s) : QAbstractListModel(parent),
-    settings(s), currentHistory(-1), driveTimer(this), m_fileBrowserOpen(false) {
+    settings(s), currentFileIndex(-1), m_scanning(false), m_searchResultsShown(false), rescanPending(false), currentHistory(-1), m_fileBrowserOpen(false), dirRecordsLoaded(false),
+    currentFileState(DVRenderState().pack()),
+    visibleFirst(-1), visibleLast(-1), thumbnailViewport(new DVThumbnailViewport) {
     /* If the setting doesn't exist this will return an empty string list. */
     m_bookmarks = settings.value("Bookmarks").toStringList();
 
-    setupFileDatabase();
+    /* Use the path of the settings file to get the path for the database. */
+    QString databasePath = settings.fileName();
+    databasePath.remove(databasePath.lastIndexOf('.'), databasePath.length()).append(".db");
 
-    /* If started in a specific directory use that. */
-    if (QDir::currentPath() != qApp->applicationDirPath())
-        initDir(QDir::currentPath());
-    /* Use a stored setting if it exists, but if not or it fails just use the home dir. */
-    else if (!(settings.contains("StartDir") && initDir(settings.value("StartDir").toString())))
-        initDir(QDir::homePath());
+    qRegisterMetaType<DVDirRecords>("DVDirRecords");
+
+    metadata = new DVMetadataService(databasePath);
+    metadata->moveToThread(&metadataThread);
+    connect(&metadataThread, &QThread::finished, metadata, &QObject::deleteLater);
+
+    connect(metadata, &DVMetadataService::dirLoaded, this, &DVFolderListing::dirRecordsArrived);
+    connect(metadata, &DVMetadataService::recordLoaded, this, &DVFolderListing::recordArrived);
+    connect(metadata, &DVMetadataService::searchFinished, this, &DVFolderListing::searchFinished);
+
+    metadataThread.start();
+
+    /* This will be the first thing the thread does, everything else gets queued up after it. */
+    QMetaObject::invokeMethod(metadata, "open", Qt::QueuedConnection);
 
     /* TODO - What other video types can we do? */
-    stereoImageSuffixes << "jps" << "pns";
+    /* JPS and PNS are made for cross-eyed viewing so they are swapped by default, MPO files have the left eye first. */
+    swappedStereoImageSuffixes << "jps" << "pns";
+    stereoImageSuffixes << swappedStereoImageSuffixes << "mpo";
     imageSuffixes << "jpg" << "jpeg" << "png" << "bmp" << stereoImageSuffixes;
     videoSuffixes << "avi" << "mp4" << "m4v" << "mkv" << "ogv" << "ogg" << "webm" << "flv" << "3gp" << "wmv" << "mpg";
 
@@ -40,49 +117,139 @@ DVFolderListing::DVFolderListing(QObject* parent, QSettings& s) : QAbstractListM
     m_currentDir.setFilter(QDir::AllDirs | QDir::NoDotAndDotDot | QDir::Files);
     m_currentDir.setSorting(QDir::DirsFirst | QDir::Name | QDir::IgnoreCase);
 
-    /* When the file changes, the stereo settings change. */
-    connect(this, &DVFolderListing::currentFileChanged, this, &DVFolderListing::currentFileStereoModeChanged);
-    connect(this, &DVFolderListing::currentFileChanged, this, &DVFolderListing::currentFileStereoSwapChanged);
-    connect(this, &DVFolderListing::currentFileChanged, this, &DVFolderListing::currentFileSurroundChanged);
-    connect(this, &DVFolderListing::currentFileChanged, this, &DVFolderListing::currentFileAudioTrackChanged);
+    qRegisterMetaType<QVector<DVFileEntry>>();
+
+    scanner = new DVFolderScanner(*this, scanGeneration);
+    scanner->moveToThread(&scanThread);
+    connect(&scanThread, &QThread::finished, scanner, &QObject::deleteLater);
+
+    connect(this, &DVFolderListing::scanRequested, scanner, &DVFolderScanner::scan);
+    connect(scanner, &DVFolderScanner::entriesFound, this, &DVFolderListing::entriesFound);
+    connect(scanner, &DVFolderScanner::scanFinished, this, &DVFolderListing::scanFinished);
+
+    connect(this, &DVFolderListing::rescanRequested, scanner, &DVFolderScanner::rescan);
+    connect(scanner, &DVFolderScanner::rescanFinished, this, &DVFolderListing::rescanFinished);
+
+    connect(this, &DVFolderListing::listRequested, scanner, &DVFolderScanner::listFiles);
+
+    rescanTimer.setSingleShot(true);
+    rescanTimer.setInterval(250);
+    connect(scanner, &DVFolderScanner::childrenCounted, this, &DVFolderListing::childrenCounted);
+
+    connect(&rescanTimer, &QTimer::timeout, this, &DVFolderListing::startRescan);
+    connect(&dirWatcher, &QFileSystemWatcher::directoryChanged, this, &DVFolderListing::dirModified);
+
+    scanThread.start();
 
-    /* TODO - Figure out a way to detect when there is actually a change rather than just putting it on a timer. */
-    connect(&driveTimer, &QTimer::timeout, this, &DVFolderListing::storageDevicePathsChanged);
-    driveTimer.start(8000);
+    m_sortMode = DVSortMode::fromString(settings.value("SortMode", "Name").toByteArray());
+    if (m_sortMode < 0) m_sortMode = DVSortMode::Name;
+    m_sortDescending = settings.value("SortDescending", false).toBool();
+    m_fileFilter = DVFileFilter::fromString(settings.value("FileFilter", "AllFiles").toByteArray());
+    if (m_fileFilter < 0) m_fileFilter = DVFileFilter::AllFiles;
+
+    /* If started in a specific directory use that. (Must be done after the filters and scanner are set up.) */
+    if (QDir::currentPath() != qApp->applicationDirPath())
+        initDir(QDir::currentPath());
+    /* Use a stored setting if it exists, but if not or it fails just use the home dir. */
+    else if (!(settings.contains("StartDir") && initDir(settings.value("StartDir").toString())))
+        initDir(QDir::homePath());
+
+    storage = new DVStorageMonitor;
+    storage->moveToThread(&storageThread);
+    connect(&storageThread, &QThread::finished, storage, &QObject::deleteLater);
+    connect(storage, &DVStorageMonitor::pathsChanged, this, &DVFolderListing::storageDevicePathsChanged);
+
+    storageThread.start();
+    QMetaObject::invokeMethod(storage, "start", Qt::QueuedConnection);
 
     m_fileBrowserOpen = settings.value("StartupFileBrowser").toBool();
+
+    indexer = new DVLibraryIndexer(*metadata, *this);
+    connect(indexer, &DVLibraryIndexer::runningChanged, this, &DVFolderListing::libraryIndexingChanged);
+    connect(indexer, &DVLibraryIndexer::fileIndexed, this, &DVFolderListing::fileIndexed);
+
+    /* Catch up on anything that changed while we weren't running. */
+    indexLibrary();
+}
+
+DVFolderListing::~DVFolderListing() {
+    /* The indexer uses the metadata service, so it has to stop first. */
+    delete indexer;
+
+    /* Make any scan in progress stop early. */
+    scanGeneration.fetchAndAddOrdered(1);
+
+    scanThread.quit();
+    scanThread.wait();
+
+    storageThread.quit();
+    storageThread.wait();
+
+    /* Make sure everything gets written before the thread stops. */
+    QMetaObject::invokeMethod(metadata, "close", Qt::BlockingQueuedConnection);
+
+    metadataThread.quit();
+    metadataThread.wait();
 }
 
 void DVFolderListing::openNext() {
-    /* Just files with the default name filter please. */
-    QFileInfoList entryList = m_currentDir.entryInfoList(QDir::Files);
+    openAdjacentFile(1);
+}
 
-    if (!entryList.empty()){
-        /* Try to find the current file in the list. */
-        int index = entryList.indexOf(m_currentFile) + 1;
+void DVFolderListing::openPrevious() {
+    openAdjacentFile(-1);
+}
+
+void DVFolderListing::openAdjacentFile(int offset) {
+    const int count = fileOrder.size();
+    int index = currentFileIndex + offset;
+
+    if (count == 0) return;
 
-        /* Wrap the index value if it ends up outside the list bounds. */
-        if (index >= entryList.count())
-            index = 0;
+    /* While still listing, the files found so far are navigated in the same order as the browser shows them.
+     * Search results are listed all at once as they arrive, so those don't need to wait. */
+    const bool listing = m_scanning && !m_searchResultsShown;
 
-        openFile(entryList[index]);
+    if (listing && (currentFileIndex < 0 || index < 0 || index >= count)) {
+        /* Either the current file hasn't been found yet, so there's nothing to move from,
+         * or the next file may not have been found yet. Stay put until the listing is done and it's known where to go. */
+        return;
     }
+
+    /* Wrap the index value if it ends up outside the list bounds. */
+    if (index >= count)
+        index = 0;
+    else if (index < 0)
+        index = count - 1;
+
+    openFile(QFileInfo(entries[fileOrder[index]].path));
 }
 
-void DVFolderListing::openPrevious() {
-    /* Just files with the default name filter please. */
-    QFileInfoList entryList = m_currentDir.entryInfoList(QDir::Files);
+QStringList DVFolderListing::neighbouringImages(int ahead, int behind) const {
+    QStringList images;
+
+    const int count = fileOrder.size();
 
-    if (!entryList.empty()){
-        /* Try to find the current file in the list. */
-        int index = entryList.indexOf(m_currentFile) - 1;
+    if (currentFileIndex < 0) return images;
 
-        /* Wrap the index value if it ends up outside the list bounds. */
-        if (index < 0)
-            index = entryList.count() - 1;
+    /* Don't go all the way around and back to the current file. */
+    ahead = qMin(ahead, count - 1);
+    behind = qMin(behind, count - 1);
 
-        openFile(entryList[index]);
+    for (int i = 1; i <= qMax(ahead, behind); ++i) {
+        if (i <= ahead) {
+            const DVFileEntry& entry = entries[fileOrder[(currentFileIndex + i) % count]];
+            if (entry.isImage() && !images.contains(entry.path))
+                images.append(entry.path);
+        }
+        if (i <= behind) {
+            const DVFileEntry& entry = entries[fileOrder[((currentFileIndex - i) % count + count) % count]];
+            if (entry.isImage() && !images.contains(entry.path))
+                images.append(entry.path);
+        }
     }
+
+    return images;
 }
 
 QString DVFolderListing::bytesToString(qint64 bytes) const {
@@ -112,14 +279,22 @@ bool DVFolderListing::openFile(QFileInfo fileInfo) {
             /* Not an image or a video, not something we can open. */
             return false;
 
-        /* Update the current dir with the new path. This function will check to see if it's the same dir. */
-        setCurrentDir(fileInfo.absolutePath());
+        /* Update the current dir with the new path. This function will check to see if it's the same dir.
+         * Search results stay listed while going through them. */
+        if (!m_searchResultsShown || !entryIndexes.contains(fileInfo.absoluteFilePath()))
+            setCurrentDir(fileInfo.absolutePath());
 
         /* Close the file browser if it was open. */
         setFileBrowserOpen(false);
 
         m_currentFile = fileInfo;
+        updateCurrentFileIndex();
+        updateCurrentFileState();
         emit currentFileChanged();
+
+        /* Files outside of the library get their layout detected too, the mode is updated when it's done. */
+        if (!isFileStereoImage(fileInfo))
+            indexer->indexFile(fileInfo.absoluteFilePath());
     }
     /* If the file was already open or was opened, we're good. */
     return true;
@@ -139,14 +314,16 @@ void DVFolderListing::setCurrentDir(QUrl url) {
 
 void DVFolderListing::setCurrentDir(QString dir) {
     /* Make sure we aren't already there so as to not lie to the model system about everything changing.
-     * Use a new QDir because filters are part of QDir comparisons, and sometimes the QString path has variations that will break things. */
-    if (QDir(dir) == QDir(m_currentDir.path()))
+     * Use a new QDir because filters are part of QDir comparisons, and sometimes the QString path has variations that will break things.
+     * When showing search results the dir needs to be listed again even if it is the same one. */
+    if (!m_searchResultsShown && QDir(dir) == QDir(m_currentDir.path()))
         return;
 
     /* Tell the model system that we're going to be changing all the things. */
     beginResetModel();
 
     if (m_currentDir.cd(dir)) {
+        startScan();
         pushHistory();
         emit currentDirChanged();
     }
@@ -167,19 +344,8 @@ void DVFolderListing::goUp() {
 }
 
 QStringList DVFolderListing::getStorageDevicePaths() const {
-    QStringList paths;
-
-    for (QStorageInfo info : QStorageInfo::mountedVolumes())
-#if defined(Q_OS_ANDROID)
-        /* In my experience anything that doesn't have "storage" or "sdcard" in it on Android is useless. */
-        if (info.rootPath().contains("storage") || info.rootPath().contains("sdcard"))
-#elif defined(Q_OS_LINUX)
-        /* Ignore tmpfs and run filesystems on Linux. */
-        if (info.device() != "tmpfs" && info.device() != "run")
-#endif
-        paths.append(info.rootPath() + ';' + info.displayName() + ";" + QString::number(info.bytesTotal()));
-
-    return paths;
+    /* Volumes are listed in the background, this is just whatever was found last. */
+    return storage->paths();
 }
 
 bool DVFolderListing::fileExists(QString file) const {
@@ -263,102 +429,266 @@ QStringList DVFolderListing::bookmarks() const {
     return m_bookmarks;
 }
 
-QSqlRecord DVFolderListing::getRecordForFile(const QFileInfo& file) const {
-    if (file.exists()) {
-        QMutexLocker locker(&dbOpMutex);
+QVariantHash DVFolderListing::getRecordForFile(const QFileInfo& file) const {
+    QString dir, name;
+
+    if (!fileDatabaseKey(file, dir, name))
+        return QVariantHash();
+
+    const QString key = dirKey(dir) + name;
+
+    /* Everything in the current dir is (or will soon be) loaded, no record there means no record at all. */
+    if (dirKey(dir) == dirRecordsPath || dirRecords.contains(key))
+        return dirRecords.value(key);
+
+    /* Not something we have already, so it's loaded in the background rather than waiting on the database thread,
+     * which may be busy with the indexer or a search. Until then the file is shown with the default values. */
+    QStringList& requestedPaths = pendingRecords[key];
 
-        QSqlQuery query;
-        query.prepare("SELECT * FROM files WHERE path = (:path)");
-        query.bindValue(":path", file.canonicalFilePath());
+    if (requestedPaths.isEmpty())
+        metadata->requestRecord(dir, name);
+    if (!requestedPaths.contains(file.absoluteFilePath()))
+        requestedPaths.append(file.absoluteFilePath());
 
-        if (query.exec() && query.next())
-            return query.record();
+    return QVariantHash();
+}
+
+void DVFolderListing::recordArrived(const QString& dir, const QString& name, const QVariantHash& record) {
+    const QString key = dirKey(dir) + name;
+    const QStringList requestedPaths = pendingRecords.take(key);
+
+    /* Anything already cached was written after the request, so it takes priority. */
+    QVariantHash& cached = dirRecords[key];
+    for (auto it = record.constBegin(); it != record.constEnd(); ++it)
+        if (!cached.contains(it.key()))
+            cached.insert(it.key(), it.value());
+
+    for (const QString& path : requestedPaths) {
+        const int entryIndex = entryIndexes.value(path, -1);
+
+        if (entryIndex >= 0) {
+            if (orderUsesRecords()) {
+                sortKeys[entryIndex] = sortKey(entries[entryIndex]);
+                updateRows();
+            }
+
+            const int row = entryRows[entryIndex];
+            if (row >= 0)
+                emit dataChanged(index(row), index(row), {IsSurroundRole, FileStereoModeRole, FileStereoSwapRole, FileTypeStringRole});
+        }
+
+        if (QFileInfo(path) == m_currentFile)
+            updateCurrentFileState();
+    }
+}
+
+void DVFolderListing::loadDirRecords() {
+    /* Everything else that was cached gets dropped too, so the cache doesn't keep growing. */
+    dirRecords.clear();
+    dirRecordsLoaded = false;
+    dirRecordsListedPath = m_currentDir.absolutePath();
+
+    const QString dir = QFileInfo(dirRecordsListedPath).canonicalFilePath();
+
+    if (dir.isEmpty()) {
+        dirRecordsPath.clear();
+        return;
     }
 
-    return QSqlRecord();
+    dirRecordsPath = dirKey(dir);
+
+    metadata->loadDir(dir);
+}
+
+void DVFolderListing::dirRecordsArrived(const QString& dir, const DVDirRecords& records) {
+    /* Records for a dir we already left. */
+    if (dirKey(dir) != dirRecordsPath)
+        return;
+
+    /* Anything already in dirRecords was written after the load was requested, so it takes priority. */
+    for (auto it = records.constBegin(); it != records.constEnd(); ++it) {
+        QVariantHash& record = dirRecords[dirRecordsPath + it.key()];
+
+        for (auto field = it.value().constBegin(); field != it.value().constEnd(); ++field)
+            if (!record.contains(field.key()))
+                record.insert(field.key(), field.value());
+    }
+
+    dirRecordsLoaded = true;
+
+    /* Any rows that were shown before now were shown with the default values. */
+    if (!rows.isEmpty())
+        emit dataChanged(index(0), index(rows.size() - 1), {IsSurroundRole, FileStereoModeRole, FileStereoSwapRole, FileTypeStringRole});
+
+    if (orderUsesRecords()) {
+        updateSortKeys();
+        updateRows();
+    }
+
+    /* The current file is usually in the current dir. */
+    if (m_currentFile.absolutePath() == dirRecordsListedPath)
+        updateCurrentFileState();
+}
+
+void DVFolderListing::fileIndexed(const QString& dir, const QString& name, const QVariantHash& values) {
+    const QString key = dirKey(dir) + name;
+
+    /* Only cached records need updating, anything else is read from the database when it's needed. */
+    if (dirKey(dir) != dirRecordsPath && !dirRecords.contains(key))
+        return;
+
+    QVariantHash& record = dirRecords[key];
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        record.insert(it.key(), it.value());
+
+    const QFileInfo file(key);
+
+    const int entryIndex = entryIndexes.value(file.absoluteFilePath(), -1);
+    if (entryIndex >= 0) {
+        /* The detected layout may move the file, or filter it in or out. */
+        if (orderUsesRecords()) {
+            sortKeys[entryIndex] = sortKey(entries[entryIndex]);
+            updateRows();
+        }
+
+        const int row = entryRows[entryIndex];
+        if (row >= 0)
+            emit dataChanged(index(row), index(row), {FileStereoModeRole, FileTypeStringRole});
+    }
+
+    if (file == m_currentFile)
+        updateCurrentFileState();
+}
+
+void DVFolderListing::updateCurrentFileState() {
+    /* Only the parts that need the database, the rest is known from the file itself. */
+    const DVFileEntry entry = entryForFile(m_currentFile);
+    const QVariantHash record = getRecordForEntry(entry);
+
+    DVRenderState state;
+    state.stereoMode = fileStereoMode(entry);
+    state.stereoSwap = fileStereoSwap(entry);
+    state.surround = isFileSurround(entry);
+    state.type = entry.type;
+
+    if (!record.isEmpty() && !record.value("audioTrack").isNull())
+        state.audioTrack = record.value("audioTrack").toInt();
+
+    const DVRenderState oldState = DVRenderState::unpack(currentFileState.fetchAndStoreOrdered(state.pack()));
+
+    if (oldState.stereoMode != state.stereoMode)
+        emit currentFileStereoModeChanged();
+    if (oldState.stereoSwap != state.stereoSwap)
+        emit currentFileStereoSwapChanged();
+    if (oldState.surround != state.surround)
+        emit currentFileSurroundChanged();
+    if (oldState.audioTrack != state.audioTrack)
+        emit currentFileAudioTrackChanged();
+}
+
+DVRenderState DVFolderListing::currentRenderState() const {
+    return DVRenderState::unpack(currentFileState.loadAcquire());
 }
 
 bool DVFolderListing::isCurrentFileStereoImage() const {
-    return isFileStereoImage(m_currentFile);
+    return currentRenderState().type == DVFileEntry::StereoImage;
 }
 bool DVFolderListing::isCurrentFileImage() const {
-    return isFileImage(m_currentFile);
+    const DVFileEntry::Type type = currentRenderState().type;
+    return type == DVFileEntry::Image || type == DVFileEntry::StereoImage;
 }
 bool DVFolderListing::isCurrentFileVideo() const {
-    return isFileVideo(m_currentFile);
+    return currentRenderState().type == DVFileEntry::Video;
 }
 
 int DVFolderListing::currentFileAudioTrack() const {
-    QSqlRecord record = getRecordForFile(m_currentFile);
-
-    return (!record.isEmpty() && !record.value("audioTrack").isNull()) ? record.value("audioTrack").toInt() : -1;
+    return currentRenderState().audioTrack;
 }
 
 void DVFolderListing::setCurrentFileAudioTrack(int track) {
     if (track == currentFileAudioTrack()) return;
 
+    /* Change signals are emitted when the state is updated. */
     updateRecordForFile(m_currentFile, "audioTrack", track);
-
-    emit currentFileAudioTrackChanged();
 }
 
 bool DVFolderListing::isCurrentFileSurround() const {
-    return isFileSurround(m_currentFile);
+    return currentRenderState().surround;
 }
 
 void DVFolderListing::setCurrentFileSurround(bool surround) {
     if (surround == isCurrentFileSurround()) return;
 
     updateRecordForFile(m_currentFile, "surround", surround, IsSurroundRole);
-
-    emit currentFileSurroundChanged();
 }
 
 DVSourceMode::Type DVFolderListing::currentFileStereoMode() const {
-    return fileStereoMode(m_currentFile);
+    return currentRenderState().stereoMode;
 }
 void DVFolderListing::setCurrentFileStereoMode(DVSourceMode::Type mode) {
     if (mode == currentFileStereoMode()) return;
 
     updateRecordForFile(m_currentFile, "stereoMode", mode, FileStereoModeRole);
-
-    emit currentFileStereoModeChanged();
 }
 
 bool DVFolderListing::currentFileStereoSwap() const {
-    return fileStereoSwap(m_currentFile);
+    return currentRenderState().stereoSwap;
 }
 void DVFolderListing::setCurrentFileStereoSwap(bool swap) {
     if (swap == currentFileStereoSwap()) return;
 
     updateRecordForFile(m_currentFile, "stereoSwap", swap, FileStereoSwapRole);
+}
 
-    emit currentFileStereoSwapChanged();
+bool DVFolderListing::currentFileDefaultSwap() const {
+    return isCurrentFileStereoImage() && swappedStereoImageSuffixes.contains(m_currentFile.suffix(), Qt::CaseInsensitive);
 }
 
 void DVFolderListing::updateRecordForFile(const QFileInfo& file, const QString& propertyName, QVariant value) {
-    QMutexLocker locker(&dbOpMutex);
+    updateRecordForFile(file, QVariantHash{{propertyName, value}});
+}
 
-    QSqlQuery query;
+void DVFolderListing::updateRecordForFile(const QFileInfo& file, const QVariantHash& values) {
+    QString dir, name;
 
-    /* Create record for file if it didn't already exist.
-     * Don't bother passing the prop/value, because the UPDATE query will be executed either way. */
-    query.prepare("INSERT OR IGNORE INTO files (path) VALUES (:path)");
-    query.bindValue(":path", file.canonicalFilePath());
-    if (!query.exec()) qWarning("Unable to create record for file! %s", qPrintable(query.lastError().text()));
+    if (!fileDatabaseKey(file, dir, name)) {
+        qWarning("Unable to create record for file that doesn't exist! \"%s\"", qPrintable(file.filePath()));
+        return;
+    }
 
-    /* Update the record with the new value. */
-    query.prepare("UPDATE files SET " + propertyName + " = :val WHERE path = :path");
-    query.bindValue(":val", value);
-    query.bindValue(":path", file.canonicalFilePath());
-    if (!query.exec()) qWarning("Unable to update record for file! %s", qPrintable(query.lastError().text()));
+    const QString key = dirKey(dir) + name;
+
+    /* Keep the cached records in sync with the database. */
+    if (dirKey(dir) == dirRecordsPath || dirRecords.contains(key)) {
+        QVariantHash& record = dirRecords[key];
+
+        for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+            record.insert(it.key(), it.value());
+    }
+
+    metadata->writeRecord(dir, name, values);
+
+    /* The file may need to move, or be filtered in or out. */
+    const int entryIndex = entryIndexes.value(file.absoluteFilePath(), -1);
+    if (entryIndex >= 0 && orderUsesRecords()) {
+        sortKeys[entryIndex] = sortKey(entries[entryIndex]);
+        updateRows();
+    }
+
+    if (file == m_currentFile)
+        updateCurrentFileState();
 }
 
 void DVFolderListing::updateRecordForFile(const QFileInfo& file, const QString& propertyName, QVariant value, Roles role) {
     updateRecordForFile(file, propertyName, value);
 
-    QModelIndex changedIndex = createIndex(m_currentDir.entryInfoList().indexOf(m_currentFile), 0);
-    emit dataChanged(changedIndex, changedIndex, {role});
+    int row = rowForFile(file);
+
+    /* Only files in the current dir are in the model. */
+    if (row >= 0) {
+        QModelIndex changedIndex = createIndex(row, 0);
+        emit dataChanged(changedIndex, changedIndex, {role});
+    }
 }
 
 qint64 DVFolderListing::currentFileSize() const {
@@ -376,16 +706,7 @@ QString DVFolderListing::currentFileInfo() const {
     return info;
 }
 QString DVFolderListing::fileTypeString(const QFileInfo& file) const {
-    if (file.isDir())
-        return tr("Folder");
-
-    QString videoImage = " " + (isFileVideo(file) ? tr("Video") : tr("Image"));
-    if (isFileSurround(file))
-        return tr("Surround") + videoImage;
-    if (fileStereoMode(file) != DVSourceMode::Mono)
-        return tr("3D") + videoImage;
-
-    return videoImage;
+    return fileTypeString(entryForFile(file));
 }
 
 bool DVFolderListing::isFileStereoImage(const QFileInfo& info) const {
@@ -399,39 +720,384 @@ bool DVFolderListing::isFileVideo(const QFileInfo& info) const {
 }
 
 bool DVFolderListing::isFileSurround(const QFileInfo &file) const {
+    return isFileSurround(entryForFile(file));
+}
+
+DVSourceMode::Type DVFolderListing::fileStereoMode(const QFileInfo& file) const {
+    return fileStereoMode(entryForFile(file));
+}
+
+bool DVFolderListing::fileStereoSwap(const QFileInfo& file) const {
+    return fileStereoSwap(entryForFile(file));
+}
+
+DVFileEntry DVFolderListing::entryForFile(const QFileInfo& file) const {
+    DVFileEntry entry;
+
+    entry.name = file.fileName();
+    entry.path = file.absoluteFilePath();
+    entry.size = file.size();
+    entry.created = file.created();
+    entry.modified = file.lastModified();
+    entry.type = fileType(file);
+    entry.isSymLink = file.isSymLink();
+
+    return entry;
+}
+
+DVFileEntry::Type DVFolderListing::fileType(const QFileInfo& file) const {
+    if (file.isDir())
+        return DVFileEntry::Directory;
+    /* Check stereo images first, as they are in the image list as well. */
+    if (stereoImageSuffixes.contains(file.suffix(), Qt::CaseInsensitive))
+        return DVFileEntry::StereoImage;
+    if (imageSuffixes.contains(file.suffix(), Qt::CaseInsensitive))
+        return DVFileEntry::Image;
+    if (videoSuffixes.contains(file.suffix(), Qt::CaseInsensitive))
+        return DVFileEntry::Video;
+
+    return DVFileEntry::Other;
+}
+
+QVariantHash DVFolderListing::getRecordForEntry(const DVFileEntry& entry) const {
+    /* Files in the current dir have all of their records loaded already (or on the way), no record there means no record at all. */
+    if (!entry.isSymLink && !dirRecordsPath.isEmpty() && QFileInfo(entry.path).absolutePath() == dirRecordsListedPath)
+        return dirRecords.value(dirRecordsPath + entry.name);
+
+    return getRecordForFile(QFileInfo(entry.path));
+}
+
+QString DVFolderListing::fileTypeString(const DVFileEntry& entry) const {
+    if (entry.isDir())
+        return tr("Folder");
+
+    QString videoImage = " " + (entry.isVideo() ? tr("Video") : tr("Image"));
+    if (isFileSurround(entry))
+        return tr("Surround") + videoImage;
+    if (fileStereoMode(entry) != DVSourceMode::Mono)
+        return tr("3D") + videoImage;
+
+    return videoImage;
+}
+
+bool DVFolderListing::isFileSurround(const DVFileEntry& entry) const {
     /* Directories and stereo images are nevver surround. */
-    if (file.isDir() || stereoImageSuffixes.contains(file.suffix(), Qt::CaseInsensitive))
+    if (entry.isDir() || entry.isStereoImage())
         return false;
 
-    QSqlRecord record = getRecordForFile(file);
+    QVariantHash record = getRecordForEntry(entry);
 
     return !record.isEmpty() && !record.value("surround").isNull() && record.value("surround").toBool();
 }
 
-DVSourceMode::Type DVFolderListing::fileStereoMode(const QFileInfo& file) const {
+DVSourceMode::Type DVFolderListing::fileStereoMode(const DVFileEntry& entry) const {
     /* Directories are side-by-side because of their thumbnail. */
-    if(file.isDir() || stereoImageSuffixes.contains(file.suffix(), Qt::CaseInsensitive))
+    if (entry.isDir() || entry.isStereoImage())
         return DVSourceMode::SideBySide;
 
-    QSqlRecord record = getRecordForFile(file);
+    QVariantHash record = getRecordForEntry(entry);
 
     /* First check the record for the file. */
     if (!record.isEmpty() && !record.value("stereoMode").isNull())
         return record.value("stereoMode").value<DVSourceMode::Type>();
 
+    /* Then what the library indexer detected, if it's sure enough. */
+    if (!record.isEmpty() && !record.value("detectedMode").isNull() &&
+        record.value("detectedConfidence").toReal() >= DVStereoDetector::minConfidence)
+        return record.value("detectedMode").value<DVSourceMode::Type>();
+
     /* If it isn't a stereo file and there isn't a value stored, just disable 3D until something is set. */
     return DVSourceMode::Mono;
 }
 
-bool DVFolderListing::fileStereoSwap(const QFileInfo& file) const {
-    QSqlRecord record = getRecordForFile(file);
+bool DVFolderListing::fileStereoSwap(const DVFileEntry& entry) const {
+    QVariantHash record = getRecordForEntry(entry);
 
     /* First check the record for the file. */
     if (!record.isEmpty() && !record.value("stereoSwap").isNull())
         return record.value("stereoSwap").toBool();
 
-    /* If there was no valid stored value, return true for stereo image files (jps & pns) and false for everything else. */
-    return isFileStereoImage(file);
+    /* If there was no valid stored value, use the default for the type of file. */
+    return defaultStereoSwap(entry);
+}
+
+bool DVFolderListing::defaultStereoSwap(const DVFileEntry& entry) const {
+    /* True for cross-eyed stereo image files (jps & pns) and false for everything else. */
+    return entry.isStereoImage() && swappedStereoImageSuffixes.contains(QFileInfo(entry.name).suffix(), Qt::CaseInsensitive);
+}
+
+int DVFolderListing::rowForFile(const QFileInfo& file) const {
+    const int index = entryIndexes.value(file.absoluteFilePath(), -1);
+
+    return index >= 0 && index < entryRows.size() ? entryRows[index] : -1;
+}
+
+qint64 DVFolderListing::sortKey(const DVFileEntry& entry) const {
+    switch (m_sortMode) {
+    case DVSortMode::Size:
+        /* The size of a dir isn't known up front, so dirs just go by name. */
+        return entry.isDir() ? 0 : entry.size;
+    case DVSortMode::Date:
+        return entry.modified.toMSecsSinceEpoch();
+    case DVSortMode::StereoMode:
+        return entry.isDir() ? 0 : fileStereoMode(entry);
+    case DVSortMode::Type:
+        return entry.type;
+    default:
+        /* Sorting by name doesn't need a key. */
+        return 0;
+    }
+}
+
+void DVFolderListing::updateSortKeys() {
+    sortKeys.resize(entries.size());
+
+    for (int i = 0; i < entries.size(); ++i)
+        sortKeys[i] = sortKey(entries[i]);
+}
+
+bool DVFolderListing::entryLessThan(int a, int b) const {
+    const DVFileEntry& x = entries[a];
+    const DVFileEntry& y = entries[b];
+
+    /* Dirs always come first, whichever way things are sorted. */
+    if (x.isDir() != y.isDir())
+        return x.isDir();
+
+    int result = 0;
+
+    if (m_sortMode == DVSortMode::NaturalName)
+        result = naturalCompare(x.name, y.name);
+    else if (sortKeys[a] != sortKeys[b])
+        result = sortKeys[a] < sortKeys[b] ? -1 : 1;
+
+    /* Anything that is otherwise equal goes by name. */
+    if (result == 0)
+        result = DVFolderScanner::compareNames(x.name, y.name);
+
+    return m_sortDescending ? result > 0 : result < 0;
+}
+
+bool DVFolderListing::isEntryShown(int index) const {
+    const DVFileEntry& entry = entries[index];
+
+    /* Dirs are always shown, so that it's still possible to get around. */
+    if (entry.isDir())
+        return true;
+
+    switch (m_fileFilter) {
+    case DVFileFilter::StereoOnly:
+        return fileStereoMode(entry) != DVSourceMode::Mono;
+    case DVFileFilter::SurroundOnly:
+        return isFileSurround(entry);
+    case DVFileFilter::VideoOnly:
+        return entry.isVideo();
+    default:
+        return true;
+    }
+}
+
+bool DVFolderListing::orderUsesRecords() const {
+    return m_sortMode == DVSortMode::StereoMode || m_fileFilter == DVFileFilter::StereoOnly || m_fileFilter == DVFileFilter::SurroundOnly;
+}
+
+void DVFolderListing::showEntries(QVector<int> indexes) {
+    /* Filtered out entries are still kept, they just don't get a row. */
+    indexes.erase(std::remove_if(indexes.begin(), indexes.end(), [this](int index) { return !isEntryShown(index); }), indexes.end());
+
+    if (indexes.isEmpty()) {
+        updateRowIndexes();
+        return;
+    }
+
+    auto lessThan = [this](int a, int b) { return entryLessThan(a, b); };
+    std::sort(indexes.begin(), indexes.end(), lessThan);
+
+    /* Where each new entry goes in the current rows. Both are sorted, so each one goes at or after the one before. */
+    QVector<int> positions;
+    positions.reserve(indexes.size());
+
+    auto from = rows.constBegin();
+    int runs = 0;
+
+    for (int index : indexes) {
+        from = std::upper_bound(from, rows.constEnd(), index, lessThan);
+
+        const int position = from - rows.constBegin();
+        if (positions.isEmpty() || positions.last() != position)
+            ++runs;
+
+        positions.append(position);
+    }
+
+    if (runs > maxRowRuns) {
+        QVector<int> merged;
+        merged.reserve(rows.size() + indexes.size());
+        std::merge(rows.constBegin(), rows.constEnd(), indexes.constBegin(), indexes.constEnd(), std::back_inserter(merged), lessThan);
+
+        beginResetModel();
+        rows = merged;
+        updateRowIndexes();
+        endResetModel();
+        return;
+    }
+
+    /* Go from the end, so that the positions of the runs before each insert stay the same. */
+    for (int end = indexes.size(); end > 0;) {
+        int start = end - 1;
+        while (start > 0 && positions[start - 1] == positions[start])
+            --start;
+
+        const int row = positions[start];
+
+        beginInsertRows(QModelIndex(), row, row + end - start - 1);
+        rows = rows.mid(0, row) + indexes.mid(start, end - start) + rows.mid(row);
+        endInsertRows();
+
+        end = start;
+    }
+
+    updateRowIndexes();
+}
+
+void DVFolderListing::hideEntries(const QVector<int>& indexes) {
+    QVector<int> removedRows;
+
+    for (int index : indexes)
+        if (entryRows[index] >= 0)
+            removedRows.append(entryRows[index]);
+
+    std::sort(removedRows.begin(), removedRows.end());
+
+    int runs = 0;
+    for (int i = 0; i < removedRows.size(); ++i)
+        if (i == 0 || removedRows[i - 1] != removedRows[i] - 1)
+            ++runs;
+
+    if (runs > maxRowRuns) {
+        QVector<int> kept;
+        kept.reserve(rows.size() - removedRows.size());
+
+        for (int row = 0, i = 0; row < rows.size(); ++row) {
+            if (i < removedRows.size() && removedRows[i] == row)
+                ++i;
+            else
+                kept.append(rows[row]);
+        }
+
+        beginResetModel();
+        rows = kept;
+        updateRowIndexes();
+        endResetModel();
+        return;
+    }
+
+    /* Go from the end, so that the rows before each run stay where they are. */
+    for (int end = removedRows.size(); end > 0;) {
+        int start = end - 1;
+        while (start > 0 && removedRows[start - 1] == removedRows[start] - 1)
+            --start;
+
+        beginRemoveRows(QModelIndex(), removedRows[start], removedRows[end - 1]);
+        rows.remove(removedRows[start], end - start);
+        endRemoveRows();
+
+        end = start;
+    }
+
+    updateRowIndexes();
+}
+
+void DVFolderListing::updateRows() {
+    QVector<int> newRows;
+
+    for (int i = 0; i < entries.size(); ++i)
+        if (isEntryShown(i))
+            newRows.append(i);
+
+    std::sort(newRows.begin(), newRows.end(), [this](int a, int b) { return entryLessThan(a, b); });
+
+    if (newRows == rows)
+        return;
+
+    const bool sameEntries = newRows.size() == rows.size() &&
+            std::all_of(newRows.constBegin(), newRows.constEnd(), [this](int i) { return i < entryRows.size() && entryRows[i] >= 0; });
+
+    if (sameEntries) {
+        /* Just the order changed, so views can keep track of where things went. */
+        emit layoutAboutToBeChanged();
+
+        const QVector<int> oldRows = rows;
+        rows = newRows;
+        updateRowIndexes();
+
+        const QModelIndexList from = persistentIndexList();
+        QModelIndexList to;
+
+        for (const QModelIndex& index : from)
+            to.append(createIndex(entryRows[oldRows[index.row()]], 0));
+
+        changePersistentIndexList(from, to);
+
+        emit layoutChanged();
+    } else {
+        beginResetModel();
+        rows = newRows;
+        updateRowIndexes();
+        endResetModel();
+    }
+}
+
+void DVFolderListing::updateRowIndexes() {
+    entryRows.fill(-1, entries.size());
+    fileIndexes.fill(-1, entries.size());
+    fileOrder.clear();
+
+    for (int row = 0; row < rows.size(); ++row) {
+        const int index = rows[row];
+
+        entryRows[index] = row;
+
+        if (!entries[index].isDir()) {
+            fileIndexes[index] = fileOrder.size();
+            fileOrder.append(index);
+        }
+    }
+
+    updateCurrentFileIndex();
+    updateThumbnailViewport();
+}
+
+void DVFolderListing::updateCurrentFileIndex() {
+    const int index = entryIndexes.value(m_currentFile.absoluteFilePath(), -1);
+
+    currentFileIndex = index >= 0 && index < fileIndexes.size() ? fileIndexes[index] : -1;
+}
+
+int DVFolderListing::childCount(const DVFileEntry& entry) const {
+    const auto cached = childCounts.constFind(entry.path);
+
+    /* Anything added to or removed from the dir changes its modification time. */
+    if (cached != childCounts.constEnd() && cached->first == entry.modified)
+        return cached->second;
+
+    if (!pendingChildCounts.contains(entry.path)) {
+        pendingChildCounts.insert(entry.path);
+        QMetaObject::invokeMethod(scanner, "countChildren", Qt::QueuedConnection, Q_ARG(QString, entry.path), Q_ARG(QDateTime, entry.modified));
+    }
+
+    /* Just a stale count is better than nothing. */
+    return cached != childCounts.constEnd() ? cached->second : -1;
+}
+
+void DVFolderListing::childrenCounted(const QString& dir, const QDateTime& modified, int count) {
+    pendingChildCounts.remove(dir);
+    childCounts.insert(dir, qMakePair(modified, count));
+
+    const int row = rowForFile(QFileInfo(dir));
+
+    if (row >= 0)
+        emit dataChanged(index(row), index(row), {FileSizeRole});
 }
 
 QHash<int, QByteArray> DVFolderListing::roleNames() const {
@@ -456,41 +1122,41 @@ QVariant DVFolderListing::data(const QModelIndex& index, int role) const {
     QVariant data;
 
     /* Make sure the index is valid. */
-    if (int(m_currentDir.count()) > index.row()) {
-        QFileInfo info = m_currentDir.entryInfoList()[index.row()];
+    if (index.row() >= 0 && index.row() < rows.size()) {
+        const DVFileEntry& entry = entries[rows[index.row()]];
 
         /* Set the return value based on the role. */
         switch (role) {
         case FileNameRole:
-            data = info.fileName();
+            data = entry.name;
             break;
         case FilePathRole:
-            data = QUrl::fromLocalFile(info.absoluteFilePath());
+            data = QUrl::fromLocalFile(entry.path);
             break;
         case IsDirRole:
-            data = info.isDir();
+            data = entry.isDir();
             break;
         case IsImageRole:
-            data = isFileImage(info);
+            data = entry.isImage();
             break;
         case IsVideoRole:
-            data = isFileVideo(info);
+            data = entry.isVideo();
             break;
         case FileSizeRole:
-            /* TODO - Should the file count be filtered to just supported files or no? */
-            data = info.isDir() ? QDir(info.absoluteFilePath()).count() : info.size();
+            /* For dirs this is the number of things in it, -1 until it has been counted. */
+            data = entry.isDir() ? childCount(entry) : entry.size;
             break;
         case FileCreatedRole:
-            data = info.created().toString();
+            data = entry.created.toString();
             break;
         case FileStereoModeRole:
-            data = fileStereoMode(info);
+            data = fileStereoMode(entry);
             break;
         case FileStereoSwapRole:
-            data = fileStereoSwap(info);
+            data = fileStereoSwap(entry);
             break;
         case FileTypeStringRole:
-            data = fileTypeString(info);
+            data = fileTypeString(entry);
             break;
         }
     }
@@ -498,7 +1164,7 @@ QVariant DVFolderListing::data(const QModelIndex& index, int role) const {
 }
 
 int DVFolderListing::rowCount(const QModelIndex&) const {
-    return int(m_currentDir.count());
+    return rows.size();
 }
 
 bool DVFolderListing::initDir(const QString& dir) {
@@ -509,12 +1175,318 @@ bool DVFolderListing::initDir(const QString& dir) {
     /* Return false if cd fails. */
     if (!m_currentDir.cd(dir)) return false;
 
+    beginResetModel();
+    startScan();
+    endResetModel();
+
     pushHistory();
 
     /* It's all good. */
     return true;
 }
 
+void DVFolderListing::clearEntries() {
+    entries.clear();
+    entryIndexes.clear();
+    sortKeys.clear();
+    rows.clear();
+    entryRows.clear();
+    fileOrder.clear();
+    fileIndexes.clear();
+    currentFileIndex = -1;
+
+    if (!dirWatcher.directories().isEmpty())
+        dirWatcher.removePaths(dirWatcher.directories());
+
+    rescanTimer.stop();
+    rescanPending = false;
+}
+
+void DVFolderListing::startScan() {
+    clearEntries();
+
+    /* Only watch the dir being shown. */
+    dirWatcher.addPath(m_currentDir.absolutePath());
+
+    if (m_searchResultsShown) {
+        m_searchResultsShown = false;
+        emit searchResultsShownChanged();
+    }
+
+    /* Get all of the stored info for the new dir in one go, rather than one query per file per role. */
+    loadDirRecords();
+
+    /* Any scan still running for the old directory will see the new generation and stop. */
+    int generation = scanGeneration.fetchAndAddOrdered(1) + 1;
+
+    emit scanRequested(generation, m_currentDir.absolutePath(), m_currentDir.nameFilters());
+
+    if (!m_scanning) {
+        m_scanning = true;
+        emit scanningChanged();
+    }
+}
+
+bool DVFolderListing::scanning() const {
+    return m_scanning;
+}
+
+void DVFolderListing::search(const QString& text, const QVariantMap& filters) {
+    beginResetModel();
+
+    /* Results come from all over, so there's no one dir to watch. */
+    clearEntries();
+
+    /* The records of the results come along with them. */
+    dirRecords.clear();
+    dirRecordsPath.clear();
+    dirRecordsListedPath.clear();
+    dirRecordsLoaded = false;
+
+    /* Stops any scan in progress, the search results are then listed with the same generation. */
+    const int generation = scanGeneration.fetchAndAddOrdered(1) + 1;
+
+    metadata->search(generation, text, filters);
+
+    if (!m_scanning) {
+        m_scanning = true;
+        emit scanningChanged();
+    }
+
+    if (!m_searchResultsShown) {
+        m_searchResultsShown = true;
+        emit searchResultsShownChanged();
+    }
+
+    endResetModel();
+}
+
+void DVFolderListing::clearSearch() {
+    if (!m_searchResultsShown) return;
+
+    beginResetModel();
+    startScan();
+    endResetModel();
+}
+
+bool DVFolderListing::searchResultsShown() const {
+    return m_searchResultsShown;
+}
+
+void DVFolderListing::searchFinished(int generation, const DVDirRecords& records) {
+    /* A search that was replaced by another one, or by going to a dir. */
+    if (generation != scanGeneration.loadAcquire())
+        return;
+
+    /* The records are keyed by path just like dirRecords, anything already there was written after the search started. */
+    for (auto it = records.constBegin(); it != records.constEnd(); ++it) {
+        QVariantHash& record = dirRecords[it.key()];
+
+        for (auto field = it.value().constBegin(); field != it.value().constEnd(); ++field)
+            if (!record.contains(field.key()))
+                record.insert(field.key(), field.value());
+    }
+
+    dirRecordsLoaded = true;
+
+    /* The files still need to be looked at, which is done on the scanner thread like any other listing. */
+    emit listRequested(generation, records.keys());
+}
+
+void DVFolderListing::entriesFound(int generation, const QVector<DVFileEntry>& newEntries) {
+    /* Results from a directory we already left. */
+    if (generation != scanGeneration.loadAcquire() || newEntries.isEmpty())
+        return;
+
+    QVector<int> added;
+
+    for (const DVFileEntry& entry : newEntries) {
+        entryIndexes.insert(entry.path, entries.size());
+        added.append(entries.size());
+
+        entries.append(entry);
+        sortKeys.append(sortKey(entry));
+    }
+
+    /* When sorted by name these all go at the end, otherwise they're merged in with what's already there. */
+    showEntries(added);
+}
+
+void DVFolderListing::scanFinished(int generation) {
+    if (generation == scanGeneration.loadAcquire() && m_scanning) {
+        m_scanning = false;
+        emit scanningChanged();
+
+        if (rescanPending) {
+            rescanPending = false;
+            rescanTimer.start();
+        }
+    }
+}
+
+void DVFolderListing::dirModified() {
+    /* The scan may have already gone past whatever changed, so check again once it's done. */
+    if (m_scanning)
+        rescanPending = true;
+    else
+        rescanTimer.start();
+}
+
+void DVFolderListing::startRescan() {
+    /* Uses the current generation, so that changing dirs makes the rescan stale too. */
+    emit rescanRequested(scanGeneration.loadAcquire(), m_currentDir.absolutePath(), m_currentDir.nameFilters());
+}
+
+void DVFolderListing::rescanFinished(int generation, const QVector<DVFileEntry>& newEntries) {
+    /* A rescan of a directory we already left, or one that started before a full scan of this one. */
+    if (generation != scanGeneration.loadAcquire() || m_scanning)
+        return;
+
+    QSet<QString> listed;
+    for (const DVFileEntry& entry : newEntries)
+        listed.insert(entry.path);
+
+    /* First take out whatever isn't there any more. */
+    QVector<int> removed;
+    for (int i = 0; i < entries.size(); ++i)
+        if (!listed.contains(entries[i].path))
+            removed.append(i);
+
+    if (!removed.isEmpty()) {
+        hideEntries(removed);
+
+        /* Then close the gaps they left, none of them have rows any more so only the indexes change. */
+        QVector<int> newIndexes(entries.size(), -1);
+        QVector<DVFileEntry> keptEntries;
+        QVector<qint64> keptKeys;
+
+        for (int i = 0; i < entries.size(); ++i) {
+            if (!listed.contains(entries[i].path)) continue;
+
+            newIndexes[i] = keptEntries.size();
+            keptEntries.append(entries[i]);
+            keptKeys.append(sortKeys[i]);
+        }
+
+        entries = keptEntries;
+        sortKeys = keptKeys;
+
+        for (int& index : rows)
+            index = newIndexes[index];
+
+        entryIndexes.clear();
+        for (int i = 0; i < entries.size(); ++i)
+            entryIndexes.insert(entries[i].path, i);
+
+        updateRowIndexes();
+    }
+
+    QVector<DVFileEntry> newFiles;
+    bool changed = false;
+
+    for (const DVFileEntry& entry : newEntries) {
+        const int entryIndex = entryIndexes.value(entry.path, -1);
+
+        if (entryIndex < 0) {
+            newFiles.append(entry);
+            continue;
+        }
+
+        /* The same entry, but it might have been written to. */
+        DVFileEntry& old = entries[entryIndex];
+
+        if (entry.size != old.size || entry.modified != old.modified || entry.type != old.type) {
+            old = entry;
+            sortKeys[entryIndex] = sortKey(entry);
+            changed = true;
+
+            const int row = entryRows[entryIndex];
+            if (row >= 0)
+                emit dataChanged(index(row), index(row));
+        }
+    }
+
+    /* Anything that changed might need to move, or be filtered in or out. */
+    if (changed)
+        updateRows();
+
+    /* Finally add the new entries, the same way as for a scan. */
+    if (!newFiles.isEmpty())
+        entriesFound(generation, newFiles);
+}
+
+DVSortMode::Type DVFolderListing::sortMode() const {
+    return m_sortMode;
+}
+
+void DVFolderListing::setSortMode(DVSortMode::Type mode) {
+    if (mode != m_sortMode) {
+        m_sortMode = mode;
+        settings.setValue("SortMode", DVSortMode::toString(mode));
+
+        updateSortKeys();
+        updateRows();
+
+        emit sortModeChanged();
+    }
+}
+
+bool DVFolderListing::sortDescending() const {
+    return m_sortDescending;
+}
+
+void DVFolderListing::setSortDescending(bool descending) {
+    if (descending != m_sortDescending) {
+        m_sortDescending = descending;
+        settings.setValue("SortDescending", descending);
+
+        updateRows();
+
+        emit sortDescendingChanged();
+    }
+}
+
+DVFileFilter::Type DVFolderListing::fileFilter() const {
+    return m_fileFilter;
+}
+
+void DVFolderListing::setFileFilter(DVFileFilter::Type filter) {
+    if (filter != m_fileFilter) {
+        m_fileFilter = filter;
+        settings.setValue("FileFilter", DVFileFilter::toString(filter));
+
+        updateRows();
+
+        emit fileFilterChanged();
+    }
+}
+
+QStringList DVFolderListing::libraryRoots() const {
+    return settings.value("LibraryRoots").toStringList();
+}
+
+void DVFolderListing::setLibraryRoots(const QStringList& roots) {
+    if (roots != libraryRoots()) {
+        settings.setValue("LibraryRoots", roots);
+        emit libraryRootsChanged();
+
+        /* New roots get indexed right away (or after a run that is already going), there is nothing to do for the ones that were removed. */
+        indexLibrary();
+    }
+}
+
+bool DVFolderListing::libraryIndexing() const {
+    return indexer->isRunning();
+}
+
+void DVFolderListing::indexLibrary() {
+    indexer->start(libraryRoots());
+}
+
+void DVFolderListing::cancelLibraryIndexing() {
+    indexer->cancel();
+}
+
 QString DVFolderListing::startDir() {
     return settings.value("StartDir").toString();
 }
@@ -558,52 +1530,37 @@ void DVFolderListing::setFileBrowserOpen(bool open) {
     }
 }
 
-void DVFolderListing::setupFileDatabase() {
-    dbOpMutex.lock();
-
-    QSqlRecord table = QSqlDatabase::database().record("files");
-    /* Check to see if the table exists. */
-    if (table.isEmpty()) {
-        /* Don't bother setting up the fields here, as that might as well just be left to the stuff below. */
-        QSqlQuery query("CREATE TABLE files (path string PRIMARY KEY)");
-        if (query.lastError().isValid()) qWarning("Error creating table! %s", qPrintable(query.lastError().text()));
-    }
+void DVFolderListing::setVisibleRows(int first, int last) {
+    visibleFirst = first;
+    visibleLast = last;
 
-    /* Add the different fields one by one, checking to see if they exist first. */
-    if (!table.contains("stereoMode")) {
-        QSqlQuery query("ALTER TABLE files ADD stereoMode integer");
-        if (query.lastError().isValid()) qWarning("Error setting up table! %s", qPrintable(query.lastError().text()));
-    }
+    updateThumbnailViewport();
+}
 
-    if (!table.contains("stereoSwap")) {
-        QSqlQuery query("ALTER TABLE files ADD stereoSwap bool");
-        if (query.lastError().isValid()) qWarning("Error setting up table! %s", qPrintable(query.lastError().text()));
-    }
+void DVFolderListing::updateThumbnailViewport() {
+    QHash<QString, int> nearby;
 
-    if (!table.contains("surround")) {
-        QSqlQuery query("ALTER TABLE files ADD surround bool");
-        if (query.lastError().isValid()) qWarning("Error setting up table! %s", qPrintable(query.lastError().text()));
-    }
+    /* The same screen on either side that the viewport prefetches. */
+    if (visibleFirst >= 0 && visibleLast >= visibleFirst) {
+        const int screen = visibleLast - visibleFirst + 1;
+        const int end = qMin(rows.size() - 1, visibleLast + screen);
 
-    if (!table.contains("audioTrack")) {
-        QSqlQuery query("ALTER TABLE files ADD audioTrack integer");
-        if (query.lastError().isValid()) qWarning("Error setting up table! %s", qPrintable(query.lastError().text()));
+        for (int row = qMax(0, visibleFirst - screen); row <= end; ++row)
+            nearby.insert(entries[rows[row]].path, row);
     }
 
-    dbOpMutex.unlock();
+    thumbnailViewport->setVisibleRows(visibleFirst, visibleLast, nearby);
 }
 
 void DVFolderListing::resetFileDatabase() {
-    dbOpMutex.lock();
-
-    /* First we delete the old table. */
-    if (!QSqlDatabase::database().record("files").isEmpty()) {
-        QSqlQuery query("DROP TABLE files");
-        if (query.lastError().isValid()) qWarning("Error deleting old table! %s", qPrintable(query.lastError().text()));
-    }
+    metadata->reset();
 
-    dbOpMutex.unlock();
+    /* This gets queued after the reset, so it will see the empty table. Search results would all be gone too. */
+    if (m_searchResultsShown)
+        clearSearch();
+    else
+        loadDirRecords();
 
-    /* Then we set up the new one. */
-    setupFileDatabase();
+    /* Nothing is stored anymore. */
+    updateCurrentFileState();
 }
@@ -0,0 +1,158 @@
+#include "dvfolderscanner.hpp"
+#include "dvfolderlisting.hpp"
+#include <QDirIterator>
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+#include <qt_windows.h>
+#elif defined(Q_OS_UNIX)
+#include <dirent.h>
+#endif
+
+namespace {
+/* The first batch is small so the first thumbnails can be shown as soon as possible,
+ * after that batches grow to cut down on the number of model updates. */
+constexpr int firstBatchSize = 32;
+constexpr int maxBatchSize = 1024;
+
+struct ScanItem {
+    QFileInfo info;
+    QString name;
+    bool isDir;
+};
+}
+
+DVFolderScanner::DVFolderScanner(const DVFolderListing& f, const QAtomicInt& generation)
+    : folderListing(f), currentGeneration(generation) { }
+
+bool DVFolderScanner::isStale(int generation) const {
+    return generation != currentGeneration.loadAcquire();
+}
+
+bool DVFolderScanner::lessThan(bool aIsDir, const QString& a, bool bIsDir, const QString& b) {
+    if (aIsDir != bIsDir)
+        return aIsDir;
+
+    return compareNames(a, b) < 0;
+}
+
+int DVFolderScanner::compareNames(const QString& a, const QString& b) {
+    const int result = a.compare(b, Qt::CaseInsensitive);
+
+    return result != 0 ? result : a.compare(b);
+}
+
+template <typename Function> bool DVFolderScanner::list(int generation, const QString& dir, const QStringList& nameFilters, Function found) {
+    QVector<ScanItem> items;
+
+    /* First just get the names and types, which is cheap compared to getting the full info for every file. */
+    QDirIterator it(dir, nameFilters, QDir::AllDirs | QDir::NoDotAndDotDot | QDir::Files);
+    while (it.hasNext()) {
+        if (isStale(generation)) return false;
+
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        items.append({info, info.fileName(), info.isDir()});
+    }
+
+    /* Sorted so that rows only ever need to be appended. */
+    std::sort(items.begin(), items.end(), [](const ScanItem& a, const ScanItem& b) {
+        return lessThan(a.isDir, a.name, b.isDir, b.name);
+    });
+
+    QVector<DVFileEntry> batch;
+    int batchSize = firstBatchSize;
+
+    for (const ScanItem& item : items) {
+        /* The user navigated somewhere else, nobody wants the rest of this directory. */
+        if (isStale(generation)) return false;
+
+        batch.append(folderListing.entryForFile(item.info));
+
+        if (batch.size() >= batchSize) {
+            found(batch);
+            batch.clear();
+            batchSize = qMin(batchSize * 2, maxBatchSize);
+        }
+    }
+
+    if (!batch.isEmpty())
+        found(batch);
+
+    return true;
+}
+
+void DVFolderScanner::scan(int generation, const QString& dir, const QStringList& nameFilters) {
+    if (list(generation, dir, nameFilters, [&](const QVector<DVFileEntry>& batch) { emit entriesFound(generation, batch); }))
+        emit scanFinished(generation);
+}
+
+void DVFolderScanner::rescan(int generation, const QString& dir, const QStringList& nameFilters) {
+    QVector<DVFileEntry> entries;
+
+    if (list(generation, dir, nameFilters, [&](const QVector<DVFileEntry>& batch) { entries += batch; }))
+        emit rescanFinished(generation, entries);
+}
+
+void DVFolderScanner::listFiles(int generation, const QStringList& paths) {
+    QVector<DVFileEntry> batch;
+    int batchSize = firstBatchSize;
+
+    for (const QString& path : paths) {
+        if (isStale(generation)) return;
+
+        const QFileInfo info(path);
+
+        /* The database can be behind, anything deleted since it was indexed isn't there to be shown. */
+        if (!info.exists()) continue;
+
+        batch.append(folderListing.entryForFile(info));
+
+        if (batch.size() >= batchSize) {
+            emit entriesFound(generation, batch);
+            batch.clear();
+            batchSize = qMin(batchSize * 2, maxBatchSize);
+        }
+    }
+
+    if (!batch.isEmpty())
+        emit entriesFound(generation, batch);
+
+    emit scanFinished(generation);
+}
+
+void DVFolderScanner::countChildren(const QString& dir, const QDateTime& modified) {
+    /* A dir that can't be read is shown as empty. */
+    int count = 0;
+
+#if defined(Q_OS_WIN)
+    /* The basic info level skips the short names, and large fetch gets more entries per call. */
+    WIN32_FIND_DATAW data;
+    HANDLE handle = FindFirstFileExW(reinterpret_cast<const wchar_t*>(QString(QDir::toNativeSeparators(dir) + "\\*").utf16()),
+                                     FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+
+    if (handle != INVALID_HANDLE_VALUE) {
+        do {
+            if (wcscmp(data.cFileName, L".") != 0 && wcscmp(data.cFileName, L"..") != 0)
+                ++count;
+        } while (FindNextFileW(handle, &data));
+
+        FindClose(handle);
+    }
+#elif defined(Q_OS_UNIX)
+    /* readdir() just returns what getdents() gives it, nothing gets stat'd. */
+    if (DIR* handle = opendir(QFile::encodeName(dir).constData())) {
+        while (const dirent* entry = readdir(handle))
+            if (qstrcmp(entry->d_name, ".") != 0 && qstrcmp(entry->d_name, "..") != 0)
+                ++count;
+
+        closedir(handle);
+    }
+#else
+    QDirIterator it(dir, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    for (; it.hasNext(); it.next())
+        ++count;
+#endif
+
+    emit childrenCounted(dir, modified, count);
+}
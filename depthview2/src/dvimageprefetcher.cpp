@@ -0,0 +1,136 @@
+#include "dvimageprefetcher.hpp"
+#include "dvfolderlisting.hpp"
+#include "dvmporeader.hpp"
+#include "dvfunctiontask.hpp"
+#include <QImageReader>
+#include <QSettings>
+#include <QFileInfo>
+
+namespace {
+int imageCost(const QImage& image) {
+    return qMax(1, image.bytesPerLine() * image.height() / 1024);
+}
+}
+
+DVImagePrefetcher::DVImagePrefetcher(QSettings& settings, DVFolderListing& f) : folderListing(f) {
+    ahead = qMax(0, settings.value("PrefetchAhead", 2).toInt());
+    behind = qMax(0, settings.value("PrefetchBehind", 1).toInt());
+    cache.setMaxCost(qMax(1, settings.value("PrefetchMemoryMB", 512).toInt()) * 1024);
+
+    /* Decoding is mostly limited by memory bandwidth, a couple of threads keeps ahead of anyone pressing a button. */
+    pool.setMaxThreadCount(2);
+}
+
+DVImagePrefetcher::~DVImagePrefetcher() {
+    pool.clear();
+    pool.waitForDone();
+}
+
+const DVImagePrefetcher::Entry* DVImagePrefetcher::findLocked(const QString& file) {
+    const Entry* entry = cache.object(file);
+
+    if (entry != nullptr && entry->modified != QFileInfo(file).lastModified()) {
+        cache.remove(file);
+        return nullptr;
+    }
+    return entry;
+}
+
+QImage DVImagePrefetcher::image(const QString& file, QSize* originalSize) {
+    {
+        QMutexLocker locker(&lock);
+
+        /* Rather than decoding it a second time, wait for the prefetch to finish. */
+        while (inProgress.contains(file))
+            decoded.wait(&lock);
+
+        if (const Entry* entry = findLocked(file)) {
+            if (originalSize)
+                *originalSize = entry->originalSize;
+            return entry->image;
+        }
+
+        inProgress.insert(file);
+    }
+
+    const Entry entry = decodeAndStore(file);
+
+    if (originalSize)
+        *originalSize = entry.originalSize;
+    return entry.image;
+}
+
+DVImagePrefetcher::Entry DVImagePrefetcher::decodeAndStore(const QString& file) {
+    Entry entry;
+    entry.modified = QFileInfo(file).lastModified();
+    entry.image = decode(file, QSize(), &entry.originalSize);
+
+    QMutexLocker locker(&lock);
+
+    /* Images larger than the whole budget are just not kept. */
+    if (!entry.image.isNull())
+        cache.insert(file, new Entry(entry), imageCost(entry.image));
+
+    inProgress.remove(file);
+    decoded.wakeAll();
+
+    return entry;
+}
+
+void DVImagePrefetcher::prefetch() {
+    const QStringList files = folderListing.neighbouringImages(ahead, behind);
+
+    QMutexLocker locker(&lock);
+
+    /* Anything still waiting for a thread is for a position we've moved away from. */
+    pool.clear();
+
+    for (const QString& file : files) {
+        /* Looking it up also marks it as recently used, so it's kept over images further away. */
+        if (inProgress.contains(file) || findLocked(file) != nullptr)
+            continue;
+
+        pool.start(new DVFunctionTask([this, file]() { prefetchFile(file); }));
+    }
+}
+
+void DVImagePrefetcher::prefetchFile(const QString& file) {
+    {
+        QMutexLocker locker(&lock);
+
+        /* It may have been requested (and decoded) while this was waiting for a thread. */
+        if (inProgress.contains(file) || findLocked(file) != nullptr)
+            return;
+
+        inProgress.insert(file);
+    }
+
+    decodeAndStore(file);
+}
+
+QImage DVImagePrefetcher::decode(const QString& file, const QSize& requestedSize, QSize* originalSize) {
+    QImage image;
+    QSize size;
+
+    if (QFileInfo(file).suffix().compare("mpo", Qt::CaseInsensitive) == 0) {
+        DVMpoReader reader(file);
+        image = reader.readSideBySide(requestedSize, &size);
+    }
+
+    /* Not an MPO, or an MPO without a valid index (in which case the first image is still a normal JPEG). */
+    if (image.isNull()) {
+        QImageReader reader(file);
+        size = reader.size();
+
+        if (size.isValid() && requestedSize.isValid())
+            reader.setScaledSize(size.scaled(requestedSize, Qt::KeepAspectRatio));
+
+        if (!reader.read(&image))
+            qWarning("Unable to load \"%s\"! %s", qPrintable(file), qPrintable(reader.errorString()));
+    }
+
+    if (originalSize)
+        *originalSize = size.isValid() ? size : image.size();
+
+    return image;
+}
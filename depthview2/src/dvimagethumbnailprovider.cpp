@@ -0,0 +1,124 @@
+#include "dvimagethumbnailprovider.hpp"
+#include "dvthumbnailresponse.hpp"
+#include "dvthumbnailcache.hpp"
+#include "dvfunctiontask.hpp"
+#include "dvexifreader.hpp"
+#include "dvmporeader.hpp"
+#include <QImageReader>
+#include <QFileInfo>
+#include <QThread>
+
+namespace {
+/* How far the aspect ratio of the embedded thumbnail may be from the main image.
+ * Cameras often letterbox wide images into a 4:3 thumbnail, and JPS files may only have one eye in theirs. */
+constexpr qreal maxAspectDifference = 0.02;
+
+/* The embedded thumbnail is only used if it shows the same thing as the main image and doesn't need to be scaled up. */
+QImage exifThumbnail(const QString& file, const QSize& originalSize, const QSize& targetSize) {
+    const QByteArray data = DVExifReader::jpegThumbnail(file);
+    if (data.isEmpty())
+        return QImage();
+
+    QImage thumbnail = QImage::fromData(data, "jpg");
+    if (thumbnail.isNull())
+        return QImage();
+
+    const qreal originalAspect = qreal(originalSize.width()) / qreal(originalSize.height());
+    const qreal thumbnailAspect = qreal(thumbnail.width()) / qreal(thumbnail.height());
+
+    if (qAbs(thumbnailAspect - originalAspect) > originalAspect * maxAspectDifference)
+        return QImage();
+
+    if (thumbnail.width() < targetSize.width() && thumbnail.height() < targetSize.height())
+        return QImage();
+
+    return thumbnail.size() == targetSize ? thumbnail : thumbnail.scaled(targetSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+}
+
+DVImageThumbnailProvider::DVImageThumbnailProvider(const QSharedPointer<DVThumbnailCache>& thumbnailCache) : cache(thumbnailCache) {
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+DVImageThumbnailProvider::~DVImageThumbnailProvider() {
+    pool.waitForDone();
+}
+
+QQuickImageResponse* DVImageThumbnailProvider::requestImageResponse(const QString& id, const QSize& requestedSize) {
+    DVThumbnailResponse* response = new DVThumbnailResponse(id, requestedSize);
+
+    pool.start(new DVFunctionTask([this, response]() { load(response); }));
+
+    return response;
+}
+
+void DVImageThumbnailProvider::load(DVThumbnailResponse* response) {
+    /* Scrolled out of view before we got to it. */
+    if (response->isCancelled()) {
+        response->finish(QImage(), "Cancelled.");
+        return;
+    }
+
+    const QFileInfo file(response->fileId());
+
+    QImage image = cache->find(file, response->size());
+
+    if (image.isNull()) {
+        QSize originalSize;
+        image = loadThumbnail(file.filePath(), response->size(), originalSize);
+
+        if (image.isNull()) {
+            response->finish(image, "Unable to load thumbnail.");
+            return;
+        }
+
+        cache->insert(file, response->size(), image, originalSize);
+    }
+
+    response->finish(image);
+}
+
+QImage DVImageThumbnailProvider::loadThumbnail(const QString& file, const QSize& requestedSize, QSize& originalSize) {
+    /* MPO thumbnails need both eyes, and the embedded thumbnail only has one. */
+    if (QFileInfo(file).suffix().compare("mpo", Qt::CaseInsensitive) == 0) {
+        DVMpoReader mpo(file);
+        QImage image = mpo.readSideBySide(requestedSize, &originalSize);
+        if (!image.isNull())
+            return image;
+    }
+
+    QImageReader reader(file);
+
+    /* Only reads the header. */
+    originalSize = reader.size();
+
+    const QSize targetSize = (originalSize.isValid() && requestedSize.isValid()) ? originalSize.scaled(requestedSize, Qt::KeepAspectRatio) : originalSize;
+
+    /* Checked by content, so this includes JPS files. */
+    if (originalSize.isValid() && reader.format() == "jpeg") {
+        QImage image = exifThumbnail(file, originalSize, targetSize);
+        if (!image.isNull())
+            return image;
+    }
+
+    /* Let the decoder do the scaling where it can, JPEG can decode at 1/2, 1/4 or 1/8 size and skip most of the work. */
+    if (targetSize.isValid())
+        reader.setScaledSize(targetSize);
+
+    QImage image;
+    if (reader.read(&image))
+        return image;
+
+    qDebug("Scaled decode failed for \"%s\", trying a full decode. %s", qPrintable(file), qPrintable(reader.errorString()));
+
+    /* Some formats can't scale while decoding, or the header was wrong about the size. */
+    QImageReader fullReader(file);
+    if (!fullReader.read(&image)) {
+        qWarning("Unable to load thumbnail for \"%s\"! %s", qPrintable(file), qPrintable(fullReader.errorString()));
+        return QImage();
+    }
+
+    originalSize = image.size();
+
+    return requestedSize.isValid() ? image.scaled(requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation) : image;
+}
@@ -0,0 +1,111 @@
+#include "dvkeyframeextractor.hpp"
+#include <QScopedPointer>
+#include <QtAV/AVDemuxer.h>
+#include <QtAV/VideoDecoder.h>
+#include <QtAV/Packet.h>
+
+namespace {
+/* If no frame comes out after this many packets something is wrong with the file, give up rather than reading the whole thing. */
+constexpr int maxPackets = 256;
+
+/* Halve the decoded size once, thumbnails never need more. Codecs that don't support it just ignore the option. */
+constexpr int lowresLevel = 1;
+
+/* Read packets until the decoder produces a frame. */
+QtAV::VideoFrame decodeFirstFrame(QtAV::AVDemuxer& demuxer, QtAV::VideoDecoder& decoder) {
+    for (int packets = 0; packets < maxPackets && demuxer.readFrame(); ) {
+        if (demuxer.stream() != demuxer.videoStream())
+            continue;
+
+        ++packets;
+
+        if (!decoder.decode(demuxer.packet()))
+            continue;
+
+        QtAV::VideoFrame frame = decoder.frame();
+        if (frame.isValid())
+            return frame;
+    }
+
+    /* The decoder may still be holding a frame. */
+    if (decoder.decode(QtAV::Packet::createEOF()))
+        return decoder.frame();
+
+    return QtAV::VideoFrame();
+}
+}
+
+DVKeyframeExtractor::DVKeyframeExtractor(qreal position) : positionFraction(qBound(0.0, position, 1.0)), reducedResolution(true) { }
+
+void DVKeyframeExtractor::setPosition(qreal position) {
+    positionFraction = qBound(0.0, position, 1.0);
+}
+
+qreal DVKeyframeExtractor::position() const {
+    return positionFraction;
+}
+
+void DVKeyframeExtractor::setReducedResolution(bool reduced) {
+    reducedResolution = reduced;
+}
+
+QImage DVKeyframeExtractor::extract(const QString& file, const QSize& requestedSize, QSize* originalSize) const {
+    QtAV::AVDemuxer demuxer;
+    demuxer.setMedia(file);
+
+    if (!demuxer.load() || demuxer.videoStream() < 0) {
+        qDebug("Unable to open \"%s\" for a thumbnail!", qPrintable(file));
+        return QImage();
+    }
+
+    QScopedPointer<QtAV::VideoDecoder> decoder(QtAV::VideoDecoder::create("FFmpeg"));
+
+    if (decoder.isNull()) {
+        qWarning("Unable to create a video decoder!");
+        return QImage();
+    }
+
+    /* Only keyframes are wanted, so let the decoder skip everything else. */
+    QVariantHash codecOptions;
+    codecOptions["skip_frame"] = "nokey";
+    if (reducedResolution)
+        codecOptions["lowres"] = lowresLevel;
+
+    QVariantHash options;
+    options["avcodec"] = codecOptions;
+
+    decoder->setCodecContext(demuxer.videoCodecContext());
+    decoder->setOptions(options);
+
+    if (!decoder->open()) {
+        qDebug("Unable to open decoder for \"%s\"!", qPrintable(file));
+        return QImage();
+    }
+
+    /* The duration is known once the container is loaded, short clips get a position inside them rather than failing. */
+    const qint64 duration = demuxer.duration();
+
+    demuxer.setSeekType(QtAV::KeyFrameSeek);
+
+    QtAV::VideoFrame frame;
+
+    if (duration > 0 && demuxer.seek(qint64(duration * positionFraction)))
+        frame = decodeFirstFrame(demuxer, *decoder);
+
+    /* Some files can't seek, or have nothing after the seek point. The first keyframe is better than nothing. */
+    if (!frame.isValid() && demuxer.seek(qint64(0))) {
+        decoder->flush();
+        frame = decodeFirstFrame(demuxer, *decoder);
+    }
+
+    if (!frame.isValid()) {
+        qDebug("Unable to decode a frame from \"%s\"!", qPrintable(file));
+        return QImage();
+    }
+
+    if (originalSize)
+        *originalSize = frame.size();
+
+    /* Scale the frame size to fit inside the requested size while maintaining aspect ratio. */
+    return frame.toImage(QImage::Format_RGB32, requestedSize.isValid() ? frame.size().scaled(requestedSize, Qt::KeepAspectRatio) : frame.size());
+}
@@ -0,0 +1,304 @@
+#include "dvlibraryindexer.hpp"
+#include "dvfolderlisting.hpp"
+#include "dvmetadataservice.hpp"
+#include "dvkeyframeextractor.hpp"
+#include "dvstereodetector.hpp"
+#include "dvfunctiontask.hpp"
+#include <QDirIterator>
+#include <QImageReader>
+#include <QRegularExpression>
+
+namespace {
+/* Walking dirs is mostly waiting on the disk, a few at a time keeps it busy without taking over the machine. */
+constexpr int indexThreads = 4;
+
+/* How sure a guess from the name of a file is. A stereo file format (JPS, MPO...) is always sure. */
+constexpr qreal nameHintConfidence = 0.75;
+
+/* Where in a video the frames for detecting the layout are taken from. The first is decoded at full resolution to get the size. */
+const qreal probePositions[] = {0.2, 0.5, 0.8};
+
+/* Do two layouts have their views in the same places, just squeezed differently? */
+bool sameArrangement(DVSourceMode::Type a, DVSourceMode::Type b) {
+    const bool aSideBySide = a == DVSourceMode::SideBySide || a == DVSourceMode::SideBySideAnamorphic;
+    const bool bSideBySide = b == DVSourceMode::SideBySide || b == DVSourceMode::SideBySideAnamorphic;
+
+    return aSideBySide == bSideBySide;
+}
+}
+
+DVLibraryIndexer::DVLibraryIndexer(DVMetadataService& m, const DVFolderListing& f)
+    : metadata(m), folderListing(f), m_running(false) {
+    pool.setMaxThreadCount(indexThreads);
+}
+
+DVLibraryIndexer::~DVLibraryIndexer() {
+    cancel();
+    pool.waitForDone();
+}
+
+bool DVLibraryIndexer::isRunning() const {
+    return m_running;
+}
+
+void DVLibraryIndexer::start(const QStringList& roots) {
+    if (roots.isEmpty()) return;
+
+    /* Roots the current run doesn't cover wait for it to finish. A cancelled run is still winding down, so it covers nothing. */
+    if (m_running) {
+        const bool cancelling = cancelled.loadAcquire();
+
+        for (const QString& root : roots)
+            if ((cancelling || !runRoots.contains(root)) && !queuedRoots.contains(root))
+                queuedRoots.append(root);
+        return;
+    }
+
+    runRoots = roots;
+
+    cancelled.storeRelease(0);
+    indexedFiles.storeRelease(0);
+    visitedDirs.clear();
+
+    m_running = true;
+    emit runningChanged();
+
+    /* Hold a count until all of the roots are queued, so the run can't finish before they all are. */
+    pendingDirs.storeRelease(1);
+
+    for (const QString& root : roots) {
+        const QString dir = QFileInfo(root).canonicalFilePath();
+
+        /* An unmounted drive or a deleted dir, leave its records alone. */
+        if (dir.isEmpty())
+            qWarning("Library root \"%s\" doesn't exist!", qPrintable(root));
+        else
+            queueDir(dir);
+    }
+
+    releaseDir();
+}
+
+void DVLibraryIndexer::cancel() {
+    cancelled.storeRelease(1);
+    queuedRoots.clear();
+}
+
+void DVLibraryIndexer::queueDir(const QString& dir) {
+    {
+        QMutexLocker locker(&visitedLock);
+
+        if (visitedDirs.contains(dir)) return;
+        visitedDirs.insert(dir);
+    }
+
+    pendingDirs.fetchAndAddOrdered(1);
+
+    pool.start(new DVFunctionTask([this, dir]() {
+        if (!cancelled.loadAcquire())
+            indexDir(dir);
+
+        releaseDir();
+    }));
+}
+
+void DVLibraryIndexer::releaseDir() {
+    /* Whichever dir is last lets the indexer's thread know that the run is done. */
+    if (pendingDirs.fetchAndAddOrdered(-1) == 1)
+        QMetaObject::invokeMethod(this, "runFinished", Qt::QueuedConnection);
+}
+
+void DVLibraryIndexer::runFinished() {
+    m_running = false;
+    emit runningChanged();
+    emit finished(indexedFiles.loadAcquire());
+
+    qDebug("Library indexing finished, %i files updated.", indexedFiles.loadAcquire());
+
+    /* Roots that were added while the run was going. */
+    if (!queuedRoots.isEmpty()) {
+        const QStringList roots = queuedRoots;
+        queuedRoots.clear();
+
+        start(roots);
+    }
+}
+
+void DVLibraryIndexer::indexDir(const QString& dir) {
+    /* Only what's there now is needed, no sorting. */
+    QDirIterator it(dir, QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
+
+    /* A set, so that checking every record against it below stays linear in big dirs. */
+    QSet<QString> names;
+    const DVDirRecords records = metadata.readDir(dir);
+
+    while (it.hasNext()) {
+        if (cancelled.loadAcquire()) return;
+
+        it.next();
+        const QFileInfo info = it.fileInfo();
+
+        if (info.isDir()) {
+            const QString subdir = info.canonicalFilePath();
+            if (!subdir.isEmpty())
+                queueDir(subdir);
+            continue;
+        }
+
+        /* Symlinked files are recorded under their target, which gets indexed if it's in the library too. */
+        if (info.isSymLink()) continue;
+
+        const DVFileEntry::Type type = folderListing.fileType(info);
+        if (type == DVFileEntry::Other) continue;
+
+        names.insert(info.fileName());
+
+        if (!needsProbe(info, records.value(info.fileName())))
+            continue;
+
+        recordFile(dir, info, type);
+        indexedFiles.fetchAndAddRelaxed(1);
+    }
+
+    /* Files that were indexed before but aren't there any more. Records without an mtime were never indexed, so they're left alone. */
+    QStringList removed;
+    for (auto record = records.constBegin(); record != records.constEnd(); ++record)
+        if (!record.value().value("mtime").isNull() && !names.contains(record.key()))
+            removed.append(record.key());
+
+    if (!removed.isEmpty())
+        metadata.removeRecords(dir, removed);
+}
+
+void DVLibraryIndexer::indexFile(const QString& path) {
+    pool.start(new DVFunctionTask([this, path]() {
+        const QFileInfo info(QFileInfo(path).canonicalFilePath());
+
+        /* Gone already. */
+        if (info.filePath().isEmpty()) return;
+
+        const DVFileEntry::Type type = folderListing.fileType(info);
+        if (type == DVFileEntry::Other || type == DVFileEntry::Directory) return;
+
+        if (needsProbe(info, metadata.readRecord(info.absolutePath(), info.fileName())))
+            recordFile(info.absolutePath(), info, type);
+    }));
+}
+
+bool DVLibraryIndexer::needsProbe(const QFileInfo& file, const QVariantHash& record) {
+    /* Nothing changed since it was last indexed. Files indexed before the layout was detected from the pixels don't have a confidence yet. */
+    return record.value("mtime").isNull() || record.value("mtime").toLongLong() != file.lastModified().toMSecsSinceEpoch() ||
+           record.value("size").toLongLong() != file.size() || record.value("detectedConfidence").isNull();
+}
+
+void DVLibraryIndexer::recordFile(const QString& dir, const QFileInfo& file, int type) {
+    const QVariantHash values = probeFile(file, type);
+
+    metadata.writeRecord(dir, file.fileName(), values);
+    emit fileIndexed(dir, file.fileName(), values);
+}
+
+QVariantHash DVLibraryIndexer::probeFile(const QFileInfo& file, int type) const {
+    QVariantHash values;
+
+    values["size"] = file.size();
+    values["mtime"] = file.lastModified().toMSecsSinceEpoch();
+    values["mediaType"] = type;
+
+    DVSourceMode::Type mode = DVSourceMode::Mono;
+    qreal confidence = 0.0;
+
+    /* Stereo image formats always have the same layout, there is nothing to detect. */
+    const bool fromName = layoutFromName(file.fileName(), mode, confidence);
+    const bool knownLayout = fromName && confidence >= 1.0;
+
+    QSize size;
+    DVStereoDetector detector;
+
+    if (type == DVFileEntry::Video) {
+        /* The video's own size is wanted here, so frames are decoded at full resolution until one gives it. */
+        DVKeyframeExtractor extractor;
+        extractor.setReducedResolution(false);
+
+        for (const qreal position : probePositions) {
+            extractor.setPosition(position);
+            detector.addFrame(extractor.extract(file.absoluteFilePath(), DVStereoDetector::frameSize(), size.isValid() ? nullptr : &size));
+
+            if (size.isValid())
+                extractor.setReducedResolution(true);
+        }
+    } else {
+        QImageReader reader(file.absoluteFilePath());
+
+        /* Only reads the header. */
+        size = reader.size();
+
+        /* Formats like JPEG can decode straight to a reduced size, which is much faster than decoding everything. */
+        if (!knownLayout && size.isValid()) {
+            reader.setScaledSize(size.scaled(DVStereoDetector::frameSize(), Qt::KeepAspectRatio));
+            detector.addFrame(reader.read());
+        }
+    }
+
+    if (size.isValid()) {
+        values["width"] = size.width();
+        values["height"] = size.height();
+    }
+
+    DVSourceMode::Type detectedMode;
+    qreal detectedConfidence;
+
+    if (!knownLayout && detector.result(size, detectedMode, detectedConfidence)) {
+        /* The name can tell full and squeezed layouts apart, which the pixels can't. So when both agree the name wins, just more sure. */
+        if (fromName && sameArrangement(mode, detectedMode)) {
+            confidence = qMax(confidence, detectedConfidence);
+        } else if (detectedConfidence > confidence) {
+            mode = detectedMode;
+            confidence = detectedConfidence;
+        }
+    }
+
+    /* Always recorded, even when nothing was found, so that the file isn't probed again until it changes. */
+    values["detectedMode"] = mode;
+    values["detectedConfidence"] = confidence;
+
+    return values;
+}
+
+bool DVLibraryIndexer::layoutFromName(const QString& fileName, DVSourceMode::Type& mode, qreal& confidence) {
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+
+    /* Stereo formats are side by side by definition (MPO files are packed that way when loaded). */
+    if (suffix == "jps" || suffix == "pns" || suffix == "mpo") {
+        mode = DVSourceMode::SideBySide;
+        confidence = 1.0;
+        return true;
+    }
+
+    /* Split into lower case words, "Movie.Half-SBS.mkv" -> "movie", "half", "sbs", "mkv". */
+    static const QRegularExpression separators("[^a-z0-9]+");
+    QStringList words = QFileInfo(fileName).completeBaseName().toLower().split(separators);
+    /* Names starting or ending with a separator leave empty words, filtered here since SkipEmptyParts moved to Qt:: in 5.14. */
+    words.removeAll(QString());
+
+    const bool half = words.contains("half");
+
+    for (const QString& word : words) {
+        if (word == "hsbs" || word == "halfsbs" || ((word == "sbs" || word == "lr") && half)) {
+            mode = DVSourceMode::SideBySideAnamorphic;
+        } else if (word == "sbs" || word == "fsbs" || word == "fullsbs" || word == "lr" || word == "3dsbs") {
+            mode = DVSourceMode::SideBySide;
+        } else if (word == "htb" || word == "hou" || word == "halftb" || word == "halfou" || ((word == "tb" || word == "ou" || word == "ab") && half)) {
+            mode = DVSourceMode::TopBottomAnamorphic;
+        } else if (word == "tb" || word == "ou" || word == "ab" || word == "ftb" || word == "fou" || word == "overunder" || word == "topbottom") {
+            mode = DVSourceMode::TopBottom;
+        } else {
+            continue;
+        }
+
+        confidence = nameHintConfidence;
+        return true;
+    }
+
+    return false;
+}
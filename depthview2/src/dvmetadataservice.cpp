@@ -0,0 +1,558 @@
+#include "dvmetadataservice.hpp"
+#include "dvenums.hpp"
+#include "dvfileentry.hpp"
+#include "dvstereodetector.hpp"
+#include <QSqlDatabase>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QFileInfo>
+#include <QTimer>
+#include <QThread>
+#include <QVersionNumber>
+
+namespace {
+/* Version 1 is the original layout, keyed only by a path column with fields added as they were needed.
+ * Version 2 splits the path into dir and name columns, so that a whole dir can be looked up through the primary key index.
+ * Version 3 adds the fields filled in by the library indexer.
+ * Version 4 adds a full text index on file names and indexes for the search filters.
+ * Version 5 includes detected layouts in the stereo mode index.
+ * Version 6 drops layouts detected before mono frames were told apart, so that they get detected again. */
+constexpr int fileDatabaseVersion = 6;
+
+/* The fields added in version 3, and their types. */
+const QList<QPair<QString, QString>> indexFields = {{"size", "integer"}, {"mtime", "integer"}, {"mediaType", "integer"},
+                                                    {"width", "integer"}, {"height", "integer"},
+                                                    {"detectedMode", "integer"}, {"detectedConfidence", "real"}};
+
+/* Run a query where the only thing that matters is whether or not it worked. */
+bool execQuery(const QSqlDatabase& db, const QString& sql, const char* errorMessage) {
+    QSqlQuery query(sql, db);
+
+    if (query.lastError().isValid()) {
+        qWarning("%s %s", errorMessage, qPrintable(query.lastError().text()));
+        return false;
+    }
+    return true;
+}
+
+/* The stereo mode the file browser shows for a file (see DVFolderListing::fileStereoMode()), as an SQL expression.
+ * It has an index of its own, which SQLite only uses for a query with this exact expression. */
+const QString stereoModeExpression =
+        QString("(CASE WHEN mediaType = %1 THEN %2 ELSE coalesce(stereoMode, CASE WHEN detectedConfidence >= %3 THEN detectedMode END, %4) END)")
+        .arg(DVFileEntry::StereoImage).arg(DVSourceMode::SideBySide).arg(DVStereoDetector::minConfidence).arg(DVSourceMode::Mono);
+
+/* Searches that match too much are cut off, nobody is going to scroll through every file in the library. */
+constexpr int maxSearchResults = 5000;
+
+/* Split search text into words the same way the full text index splits names. */
+QStringList searchWords(const QString& text) {
+    QStringList words;
+    QString word;
+
+    for (const QChar c : text) {
+        if (c.isLetterOrNumber()) {
+            word += c;
+        } else if (!word.isEmpty()) {
+            words << word;
+            word.clear();
+        }
+    }
+    if (!word.isEmpty())
+        words << word;
+
+    return words;
+}
+
+QVariantHash recordToHash(const QSqlRecord& record) {
+    QVariantHash hash;
+
+    for (int i = 0; i < record.count(); ++i)
+        hash.insert(record.fieldName(i), record.value(i));
+
+    return hash;
+}
+}
+
+DVMetadataService::DVMetadataService(const QString& path)
+    : databasePath(path), connectionName("DVMetadata"), canUpsert(false), hasNameIndex(false), flushTimer(nullptr) { }
+
+QSqlDatabase DVMetadataService::database() const {
+    /* Don't try to open it here, that is only done once in open(). */
+    return QSqlDatabase::database(connectionName, false);
+}
+
+void DVMetadataService::open() {
+    /* The connection must be created on the thread that uses it. */
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(databasePath);
+
+    if (!db.open()) {
+        qWarning("Error opening database! %s", qPrintable(db.lastError().text()));
+        return;
+    }
+
+    /* Writes that happen close together are committed together, once there is nothing else in the queue. */
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(0);
+    connect(flushTimer, &QTimer::timeout, this, &DVMetadataService::flushWrites);
+
+    setupDatabase();
+}
+
+void DVMetadataService::close() {
+    flushWrites();
+    clearQueries();
+
+    /* The QSqlDatabase handle must be gone before the connection can be removed. */
+    {
+        QSqlDatabase db = database();
+        if (db.isOpen()) db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+void DVMetadataService::setupDatabase() {
+    QSqlDatabase db = database();
+
+    /* With a write-ahead log commits don't need to wait for the whole database to be synced to disk,
+     * and NORMAL sync is safe in WAL mode (at worst the last few commits are lost on power failure). */
+    execQuery(db, "PRAGMA journal_mode = WAL", "Unable to enable WAL mode!");
+    execQuery(db, "PRAGMA synchronous = NORMAL", "Unable to set sync mode!");
+
+    /* UPSERT was added in SQLite 3.24, older versions need an INSERT followed by an UPDATE. */
+    QSqlQuery sqliteVersion("SELECT sqlite_version()", db);
+    canUpsert = sqliteVersion.next() && QVersionNumber::fromString(sqliteVersion.value(0).toString()) >= QVersionNumber(3, 24);
+
+    QSqlQuery versionQuery("PRAGMA user_version", db);
+    const int version = versionQuery.next() ? versionQuery.value(0).toInt() : 0;
+
+    if (version < fileDatabaseVersion) {
+        /* Do it all at once so that a failure can't leave things half migrated, the old table is only dropped once it has been copied. */
+        db.transaction();
+
+        if (!upgradeDatabase(db) || !db.commit()) {
+            qWarning("Error upgrading database to version %i, keeping the old one! %s", fileDatabaseVersion, qPrintable(db.lastError().text()));
+            db.rollback();
+        }
+    }
+
+    /* FTS5 is an optional SQLite module, without it names are searched with LIKE instead. */
+    QSqlQuery nameIndex("SELECT 1 FROM sqlite_master WHERE name = 'files_fts'", db);
+    hasNameIndex = nameIndex.next();
+
+    /* Prepare the queries that get used all the time. */
+    recordQuery = QSqlQuery(db);
+    recordQuery.prepare("SELECT * FROM files WHERE dir = :dir AND name = :name");
+    dirRecordsQuery = QSqlQuery(db);
+    dirRecordsQuery.prepare("SELECT * FROM files WHERE dir = :dir");
+    insertQuery = QSqlQuery(db);
+    insertQuery.prepare("INSERT OR IGNORE INTO files (dir, name) VALUES (:dir, :name)");
+    removeQuery = QSqlQuery(db);
+    removeQuery.prepare("DELETE FROM files WHERE dir = :dir AND name = :name");
+}
+
+bool DVMetadataService::upgradeDatabase(const QSqlDatabase& db) {
+    QSqlRecord table = db.record("files");
+
+    /* Move the old table out of the way so that it can be copied into the new one. */
+    const bool migrate = table.contains("path");
+    if (migrate && !execQuery(db, "ALTER TABLE files RENAME TO files_v1", "Error renaming old table!"))
+        return false;
+
+    /* A version 2 table only needs the new fields. */
+    const bool addFields = !migrate && table.contains("dir");
+
+    if (addFields) {
+        /* The library indexer probes files without a confidence again. */
+        if (table.contains("detectedConfidence") &&
+            !execQuery(db, "UPDATE files SET detectedMode = NULL, detectedConfidence = NULL", "Error clearing detected layouts!"))
+            return false;
+
+        for (const auto& field : indexFields)
+            if (!table.contains(field.first) && !execQuery(db, "ALTER TABLE files ADD COLUMN " + field.first + ' ' + field.second, "Error adding field!"))
+                return false;
+    } else {
+        QStringList fields;
+        for (const auto& field : indexFields)
+            fields << field.first + ' ' + field.second;
+
+        /* The primary key index starts with dir, so it doubles as the index for looking up all files in a dir. */
+        if (!execQuery(db, "CREATE TABLE files ("
+                           "dir text NOT NULL, "
+                           "name text NOT NULL, "
+                           "stereoMode integer, "
+                           "stereoSwap integer, "
+                           "surround integer, "
+                           "audioTrack integer, " +
+                           fields.join(", ") + ", "
+                           "PRIMARY KEY (dir, name))", "Error creating table!"))
+            return false;
+    }
+
+    if (migrate) {
+        /* Old databases may be missing fields that were added later, so select everything and check for each one. */
+        QSqlQuery oldRecords("SELECT * FROM files_v1", db);
+        const QSqlRecord oldFields = oldRecords.record();
+
+        if (oldRecords.lastError().isValid()) {
+            qWarning("Error reading old records! %s", qPrintable(oldRecords.lastError().text()));
+            return false;
+        }
+
+        QSqlQuery insert(db);
+        insert.prepare("INSERT OR REPLACE INTO files (dir, name, stereoMode, stereoSwap, surround, audioTrack) "
+                       "VALUES (:dir, :name, :stereoMode, :stereoSwap, :surround, :audioTrack)");
+
+        int migrated = 0;
+        while (oldRecords.next()) {
+            /* The old paths were already canonical, so they can just be split. */
+            QFileInfo path(oldRecords.value("path").toString());
+
+            insert.bindValue(":dir", path.absolutePath());
+            insert.bindValue(":name", path.fileName());
+
+            for (const char* field : {"stereoMode", "stereoSwap", "surround", "audioTrack"}) {
+                QVariant value = oldFields.contains(field) ? oldRecords.value(field) : QVariant();
+
+                /* Old boolean fields could be stored in different ways, everything is an integer now. */
+                insert.bindValue(QString(":") + field, value.isNull() ? QVariant(QVariant::Int) : QVariant(value.toInt()));
+            }
+
+            /* Losing any record would be worse than not upgrading at all. */
+            if (!insert.exec()) {
+                qWarning("Error migrating record! %s", qPrintable(insert.lastError().text()));
+                return false;
+            }
+            ++migrated;
+        }
+
+        qDebug("Migrated %i file records to database version %i.", migrated, fileDatabaseVersion);
+
+        if (!execQuery(db, "DROP TABLE files_v1", "Error deleting old table!"))
+            return false;
+    }
+
+    /* Made again in case the expression changed. */
+    return execQuery(db, "DROP INDEX IF EXISTS files_stereoMode", "Error deleting stereo mode index!") && setupSearch(db) &&
+           execQuery(db, QString("PRAGMA user_version = %1").arg(fileDatabaseVersion), "Error setting database version!");
+}
+
+bool DVMetadataService::setupSearch(const QSqlDatabase& db) {
+    /* Each search filter can be answered from an index instead of looking at every record. */
+    if (!execQuery(db, "CREATE INDEX IF NOT EXISTS files_mediaType ON files (mediaType)", "Error creating media type index!") ||
+        !execQuery(db, "CREATE INDEX IF NOT EXISTS files_stereoMode ON files " + stereoModeExpression, "Error creating stereo mode index!") ||
+        !execQuery(db, "CREATE INDEX IF NOT EXISTS files_surround ON files (surround)", "Error creating surround index!") ||
+        !execQuery(db, "CREATE INDEX IF NOT EXISTS files_mtime ON files (mtime)", "Error creating modification time index!"))
+        return false;
+
+    /* The names are only stored once, in the files table, the full text index just refers to its rowids.
+     * Those only change when the database is vacuumed, which is never done. */
+    QSqlQuery createIndex("CREATE VIRTUAL TABLE IF NOT EXISTS files_fts USING fts5 (name, content = 'files', content_rowid = 'rowid')", db);
+
+    if (createIndex.lastError().isValid()) {
+        qDebug("Full text search isn't available, searching file names will be slower. %s", qPrintable(createIndex.lastError().text()));
+        return true;
+    }
+
+    /* Keep the index in sync with the table. The upserts only ever change other fields, so updates of the name are rare. */
+    return execQuery(db, "CREATE TRIGGER IF NOT EXISTS files_fts_insert AFTER INSERT ON files BEGIN "
+                         "INSERT INTO files_fts (rowid, name) VALUES (new.rowid, new.name); END", "Error creating full text insert trigger!") &&
+           execQuery(db, "CREATE TRIGGER IF NOT EXISTS files_fts_delete AFTER DELETE ON files BEGIN "
+                         "INSERT INTO files_fts (files_fts, rowid, name) VALUES ('delete', old.rowid, old.name); END",
+                     "Error creating full text delete trigger!") &&
+           execQuery(db, "CREATE TRIGGER IF NOT EXISTS files_fts_update AFTER UPDATE OF name ON files BEGIN "
+                         "INSERT INTO files_fts (files_fts, rowid, name) VALUES ('delete', old.rowid, old.name); "
+                         "INSERT INTO files_fts (rowid, name) VALUES (new.rowid, new.name); END", "Error creating full text update trigger!") &&
+           /* Index anything that was already in the table. */
+           execQuery(db, "INSERT INTO files_fts (files_fts) VALUES ('rebuild')", "Error building full text index!");
+}
+
+void DVMetadataService::clearQueries() {
+    upsertQueries.clear();
+    recordQuery = QSqlQuery();
+    dirRecordsQuery = QSqlQuery();
+    insertQuery = QSqlQuery();
+    removeQuery = QSqlQuery();
+}
+
+void DVMetadataService::loadDir(const QString& dir) {
+    QMetaObject::invokeMethod(this, "loadDirImpl", Qt::QueuedConnection, Q_ARG(QString, dir));
+}
+
+void DVMetadataService::requestRecord(const QString& dir, const QString& name) {
+    QMetaObject::invokeMethod(this, "requestRecordImpl", Qt::QueuedConnection, Q_ARG(QString, dir), Q_ARG(QString, name));
+}
+
+void DVMetadataService::writeRecord(const QString& dir, const QString& name, const QVariantHash& values) {
+    QMetaObject::invokeMethod(this, "writeRecordImpl", Qt::QueuedConnection,
+                              Q_ARG(QString, dir), Q_ARG(QString, name), Q_ARG(QVariantHash, values));
+}
+
+void DVMetadataService::removeRecords(const QString& dir, const QStringList& names) {
+    QMetaObject::invokeMethod(this, "removeRecordsImpl", Qt::QueuedConnection, Q_ARG(QString, dir), Q_ARG(QStringList, names));
+}
+
+void DVMetadataService::search(int id, const QString& text, const QVariantMap& filters) {
+    QMetaObject::invokeMethod(this, "searchImpl", Qt::QueuedConnection, Q_ARG(int, id), Q_ARG(QString, text), Q_ARG(QVariantMap, filters));
+}
+
+void DVMetadataService::reset() {
+    QMetaObject::invokeMethod(this, "resetImpl", Qt::QueuedConnection);
+}
+
+QVariantHash DVMetadataService::readRecord(const QString& dir, const QString& name) {
+    /* A blocking call to our own thread would never return. */
+    if (QThread::currentThread() == thread())
+        return readRecordImpl(dir, name);
+
+    QVariantHash record;
+    QMetaObject::invokeMethod(this, "readRecordImpl", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(QVariantHash, record), Q_ARG(QString, dir), Q_ARG(QString, name));
+    return record;
+}
+
+DVDirRecords DVMetadataService::readDir(const QString& dir) {
+    if (QThread::currentThread() == thread())
+        return readDirImpl(dir);
+
+    DVDirRecords records;
+    QMetaObject::invokeMethod(this, "readDirImpl", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(DVDirRecords, records), Q_ARG(QString, dir));
+    return records;
+}
+
+void DVMetadataService::loadDirImpl(const QString& dir) {
+    emit dirLoaded(dir, readDirImpl(dir));
+}
+
+DVDirRecords DVMetadataService::readDirImpl(const QString& dir) {
+    /* Make sure everything in the database is up to date. */
+    flushWrites();
+
+    DVDirRecords records;
+
+    /* The dir is the first column of the primary key, so this is an index lookup. */
+    dirRecordsQuery.bindValue(":dir", dir);
+
+    if (dirRecordsQuery.exec()) {
+        while (dirRecordsQuery.next())
+            records.insert(dirRecordsQuery.value("name").toString(), recordToHash(dirRecordsQuery.record()));
+    } else {
+        qWarning("Unable to load records for dir! %s", qPrintable(dirRecordsQuery.lastError().text()));
+    }
+
+    /* Done with the result, let SQLite reset the statement for the next time. */
+    dirRecordsQuery.finish();
+
+    return records;
+}
+
+void DVMetadataService::requestRecordImpl(const QString& dir, const QString& name) {
+    emit recordLoaded(dir, name, readRecordImpl(dir, name));
+}
+
+QVariantHash DVMetadataService::readRecordImpl(const QString& dir, const QString& name) {
+    flushWrites();
+
+    QVariantHash record;
+
+    recordQuery.bindValue(":dir", dir);
+    recordQuery.bindValue(":name", name);
+
+    if (recordQuery.exec() && recordQuery.next())
+        record = recordToHash(recordQuery.record());
+
+    recordQuery.finish();
+
+    return record;
+}
+
+void DVMetadataService::writeRecordImpl(const QString& dir, const QString& name, const QVariantHash& values) {
+    /* Merge with any other values still waiting to be written for the same file. */
+    QVariantHash& pending = pendingWrites[qMakePair(dir, name)];
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        pending.insert(it.key(), it.value());
+
+    if (flushTimer != nullptr && !flushTimer->isActive())
+        flushTimer->start();
+}
+
+void DVMetadataService::removeRecordsImpl(const QString& dir, const QStringList& names) {
+    QSqlDatabase db = database();
+    db.transaction();
+
+    for (const QString& name : names) {
+        /* Don't write a record back after it was removed. */
+        pendingWrites.remove(qMakePair(dir, name));
+
+        removeQuery.bindValue(":dir", dir);
+        removeQuery.bindValue(":name", name);
+        if (!removeQuery.exec()) qWarning("Unable to remove record for file! %s", qPrintable(removeQuery.lastError().text()));
+    }
+
+    if (!db.commit())
+        qWarning("Unable to commit removing file records! %s", qPrintable(db.lastError().text()));
+}
+
+void DVMetadataService::searchImpl(int id, const QString& text, const QVariantMap& filters) {
+    flushWrites();
+
+    QString tables = "files";
+    QStringList conditions;
+    QVariantList values;
+
+    const QStringList words = searchWords(text);
+
+    if (!words.isEmpty()) {
+        if (hasNameIndex) {
+            /* Every word has to be in the name, as the start of a word in the name. */
+            QStringList terms;
+            for (const QString& word : words)
+                terms << '"' + word + "\"*";
+
+            tables = "files_fts JOIN files ON files.rowid = files_fts.rowid";
+            conditions << "files_fts MATCH ?";
+            values << terms.join(' ');
+        } else {
+            /* The words are only letters and numbers, so there is nothing to escape. */
+            for (const QString& word : words) {
+                conditions << "name LIKE ?";
+                values << '%' + word + '%';
+            }
+        }
+    }
+
+    if (filters.contains("stereo"))
+        conditions << stereoModeExpression + (filters["stereo"].toBool() ? " != " : " = ") + QString::number(DVSourceMode::Mono);
+    if (filters.contains("stereoMode")) {
+        conditions << stereoModeExpression + " = ?";
+        values << filters["stereoMode"].toInt();
+    }
+    if (filters.contains("surround"))
+        conditions << (filters["surround"].toBool() ? "surround = 1" : "coalesce(surround, 0) = 0");
+    if (filters.contains("video"))
+        conditions << (filters["video"].toBool() ? QString("mediaType = %1").arg(DVFileEntry::Video)
+                                                 : QString("mediaType IN (%1, %2)").arg(DVFileEntry::Image).arg(DVFileEntry::StereoImage));
+    if (filters.contains("modifiedAfter")) {
+        conditions << "mtime >= ?";
+        values << filters["modifiedAfter"].toDateTime().toMSecsSinceEpoch();
+    }
+    if (filters.contains("modifiedBefore")) {
+        conditions << "mtime < ?";
+        values << filters["modifiedBefore"].toDateTime().toMSecsSinceEpoch();
+    }
+
+    DVDirRecords records;
+
+    /* Searching with nothing to search for would just list the whole database. */
+    if (conditions.isEmpty()) {
+        emit searchFinished(id, records);
+        return;
+    }
+
+    QSqlQuery query(database());
+    query.prepare("SELECT files.* FROM " + tables + " WHERE " + conditions.join(" AND ") + QString(" LIMIT %1").arg(maxSearchResults));
+
+    for (int i = 0; i < values.size(); ++i)
+        query.bindValue(i, values[i]);
+
+    if (query.exec()) {
+        while (query.next()) {
+            const QString dir = query.value("dir").toString();
+            records.insert((dir.endsWith('/') ? dir : dir + '/') + query.value("name").toString(), recordToHash(query.record()));
+        }
+    } else {
+        qWarning("Unable to search file records! %s", qPrintable(query.lastError().text()));
+    }
+
+    if (records.size() == maxSearchResults)
+        qDebug("Search matched more than %i files, only the first ones are shown.", maxSearchResults);
+
+    emit searchFinished(id, records);
+}
+
+void DVMetadataService::resetImpl() {
+    /* Prepared statements keep the table locked, and would be invalid after it is recreated anyway. */
+    clearQueries();
+
+    /* Anything that wasn't written yet is gone too. */
+    pendingWrites.clear();
+
+    QSqlDatabase db = database();
+
+    /* First we delete the old table, along with its indexes and triggers. The full text index is a table of its own. */
+    execQuery(db, "DROP TABLE IF EXISTS files_fts", "Error deleting full text index!");
+    if (!db.record("files").isEmpty())
+        execQuery(db, "DROP TABLE files", "Error deleting old table!");
+
+    /* Make sure the table is created from scratch. */
+    execQuery(db, "PRAGMA user_version = 0", "Error resetting database version!");
+
+    /* Then we set up the new one. */
+    setupDatabase();
+}
+
+void DVMetadataService::flushWrites() {
+    if (pendingWrites.isEmpty()) return;
+
+    QSqlDatabase db = database();
+    db.transaction();
+
+    for (auto it = pendingWrites.constBegin(); it != pendingWrites.constEnd(); ++it) {
+        const QString& dir = it.key().first;
+        const QString& name = it.key().second;
+        const QVariantHash& values = it.value();
+
+        QStringList fields = values.keys();
+        /* Sort so that the same set of fields always gets the same statement. */
+        fields.sort();
+
+        QSqlQuery& query = upsertQuery(fields);
+
+        /* Without UPSERT support the record must be created first, then updated. */
+        if (!canUpsert) {
+            insertQuery.bindValue(":dir", dir);
+            insertQuery.bindValue(":name", name);
+            if (!insertQuery.exec()) qWarning("Unable to create record for file! %s", qPrintable(insertQuery.lastError().text()));
+        }
+
+        query.bindValue(":dir", dir);
+        query.bindValue(":name", name);
+        for (const QString& field : fields)
+            query.bindValue(':' + field, values[field]);
+
+        if (!query.exec()) qWarning("Unable to update record for file! %s", qPrintable(query.lastError().text()));
+    }
+
+    if (!db.commit())
+        qWarning("Unable to commit file records! %s", qPrintable(db.lastError().text()));
+
+    pendingWrites.clear();
+}
+
+QSqlQuery& DVMetadataService::upsertQuery(const QStringList& fields) {
+    const QString key = fields.join(',');
+
+    auto it = upsertQueries.find(key);
+
+    /* Only prepare each combination of fields once. */
+    if (it == upsertQueries.end()) {
+        QStringList values, updates;
+        for (const QString& field : fields) {
+            values << ':' + field;
+            updates << field + " = " + (canUpsert ? "excluded." : ":") + field;
+        }
+
+        QSqlQuery query(database());
+        if (canUpsert)
+            query.prepare("INSERT INTO files (dir, name, " + fields.join(", ") + ") VALUES (:dir, :name, " + values.join(", ") + ") "
+                          "ON CONFLICT (dir, name) DO UPDATE SET " + updates.join(", "));
+        else
+            query.prepare("UPDATE files SET " + updates.join(", ") + " WHERE dir = :dir AND name = :name");
+
+        it = upsertQueries.insert(key, query);
+    }
+
+    return *it;
+}
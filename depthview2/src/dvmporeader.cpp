@@ -0,0 +1,174 @@
+#include "dvmporeader.hpp"
+#include "dvtiffreader.hpp"
+#include <QImageReader>
+#include <QPainter>
+#include <QBuffer>
+#include <cstring>
+
+namespace {
+/* JPEG markers. */
+constexpr uchar markerStart = 0xff;
+constexpr uchar markerSOI = 0xd8;
+constexpr uchar markerAPP2 = 0xe2;
+constexpr uchar markerSOS = 0xda;
+
+/* The MP Entry tag in the MP Index IFD, an array of 16 byte entries, one for each image. */
+constexpr quint16 tagMPEntry = 0xb002;
+constexpr quint32 mpEntrySize = 16;
+
+QImage decodeEye(const QByteArray& data, const QSize& targetSize) {
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer, "jpg");
+
+    /* JPEG can decode at 1/2, 1/4 or 1/8 size, much cheaper than a full decode. */
+    if (targetSize.isValid() && reader.size().isValid())
+        reader.setScaledSize(reader.size().scaled(targetSize, Qt::KeepAspectRatio));
+
+    QImage image;
+    if (!reader.read(&image))
+        qWarning("Unable to decode MPO image! %s", qPrintable(reader.errorString()));
+
+    return image;
+}
+}
+
+DVMpoReader::DVMpoReader(const QString& fileName) : file(fileName), data(nullptr), size(0) {
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open \"%s\"! %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return;
+    }
+
+    size = file.size();
+    data = file.map(0, size);
+
+    if (data == nullptr) {
+        qWarning("Unable to map \"%s\"! %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return;
+    }
+
+    if (!readIndex()) {
+        qWarning("No valid MPF index in \"%s\"!", qPrintable(fileName));
+        images.clear();
+    }
+}
+
+DVMpoReader::~DVMpoReader() {
+    if (data != nullptr)
+        file.unmap(const_cast<uchar*>(data));
+}
+
+bool DVMpoReader::readIndex() {
+    if (size < 4 || data[0] != markerStart || data[1] != markerSOI)
+        return false;
+
+    /* Walk the segments of the first image until the MPF one. */
+    for (qint64 pos = 2; pos + 4 <= size;) {
+        if (data[pos] != markerStart || data[pos + 1] == markerSOS)
+            return false;
+
+        /* The length counts itself, but not the marker. */
+        const qint64 length = qFromBigEndian<quint16>(data + pos + 2);
+        const qint64 segment = pos + 4;
+
+        if (length < 2)
+            return false;
+
+        if (data[pos + 1] == markerAPP2 && segment + 4 <= size && memcmp(data + segment, "MPF\0", 4) == 0) {
+            /* Too short to hold even the identifier. */
+            if (length < 6)
+                return false;
+
+            /* All offsets in the index are relative to the TIFF header that comes right after the identifier.
+             * It can't go past the end of the segment, or the end of the file if that's cut short. */
+            const qint64 base = segment + 4;
+            DVTiffReader tiff(data + base, quint32(qMin(size - base, pos + 2 + length - base)));
+
+            if (!tiff.readHeader())
+                return false;
+
+            const quint32 entry = tiff.findEntry(tiff.firstIfd(), tagMPEntry);
+            if (entry == 0)
+                return false;
+
+            const quint32 count = tiff.u32(entry + 4) / mpEntrySize;
+            const quint32 entries = tiff.u32(entry + 8);
+
+            if (!tiff.contains(entries, count * mpEntrySize))
+                return false;
+
+            for (quint32 i = 0; i < count; ++i) {
+                Image image;
+                image.length = tiff.u32(entries + i * mpEntrySize + 4);
+                /* The first image's offset is always zero, as it starts at the beginning of the file. */
+                const quint32 offset = tiff.u32(entries + i * mpEntrySize + 8);
+                image.offset = (i == 0) ? 0 : base + offset;
+
+                if (image.offset + image.length > size)
+                    return false;
+
+                images.append(image);
+            }
+
+            return images.size() >= 2;
+        }
+
+        pos += 2 + length;
+    }
+
+    return false;
+}
+
+bool DVMpoReader::isValid() const {
+    return images.size() >= 2;
+}
+
+int DVMpoReader::imageCount() const {
+    return images.size();
+}
+
+QByteArray DVMpoReader::imageData(int index) const {
+    if (index < 0 || index >= images.size())
+        return QByteArray();
+
+    /* Points straight into the mapped file. */
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(data + images[index].offset), int(images[index].length));
+}
+
+QImage DVMpoReader::readSideBySide(const QSize& requestedSize, QSize* originalSize) {
+    if (!isValid())
+        return QImage();
+
+    /* Each eye gets half the width. */
+    const QSize eyeSize = requestedSize.isValid() ? QSize(requestedSize.width() / 2, requestedSize.height()) : QSize();
+
+    /* One after the other, callers already decode several files at once on their own threads. */
+    const QImage left = decodeEye(imageData(0), eyeSize);
+    const QImage right = left.isNull() ? QImage() : decodeEye(imageData(1), eyeSize);
+
+    if (left.isNull() || right.isNull())
+        return QImage();
+
+    if (originalSize) {
+        /* Only the headers need to be read for this. */
+        QBuffer buffer;
+        buffer.setData(imageData(0));
+        buffer.open(QIODevice::ReadOnly);
+        const QSize fullEye = QImageReader(&buffer, "jpg").size();
+
+        *originalSize = fullEye.isValid() ? QSize(fullEye.width() * 2, fullEye.height()) : QSize(left.width() * 2, left.height());
+    }
+
+    /* The eyes should be the same size, but don't trust the camera. */
+    QImage packed(left.width() * 2, left.height(), QImage::Format_RGB32);
+    packed.fill(Qt::black);
+
+    QPainter painter(&packed);
+    painter.drawImage(QRect(0, 0, left.width(), left.height()), left);
+    painter.drawImage(QRect(left.width(), 0, left.width(), left.height()), right);
+    painter.end();
+
+    return packed;
+}
@@ -243,6 +243,7 @@ void DVQmlCommunication::registerFileTypes() {
 
     addRegistryEntry("Software\\Classes\\.jps", progID, error);
     addRegistryEntry("Software\\Classes\\.pns", progID, error);
+    addRegistryEntry("Software\\Classes\\.mpo", progID, error);
 
     /* TODO - Add video and standard image formats in a way that doesn't override the main association. */
 
@@ -252,7 +253,7 @@ void DVQmlCommunication::registerFileTypes() {
     addRegistryEntry("Software\\Classes\\" + progID + "\\shell\\open\\command", command, error);
 
     if (error.isNull())
-        QMessageBox::information(nullptr, QObject::tr("Success!"), QObject::tr("Successfully associated .jps and .pns files with DepthView."));
+        QMessageBox::information(nullptr, QObject::tr("Success!"), QObject::tr("Successfully associated .jps, .pns and .mpo files with DepthView."));
     else
         QMessageBox::warning(nullptr, QObject::tr("Error setting file association!"), error);
 }
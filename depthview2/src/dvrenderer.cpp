@@ -142,6 +142,9 @@ void DVRenderer::paintGL() {
     /* Now we don't want QML messing us up. */
     window->resetOpenGLState();
 
+    /* Everything drawn this frame uses the same values, even if the file changes partway through. */
+    m_frameState = folderListing.currentRenderState();
+
     /* Bind the shader and set uniforms for the current draw mode. */
     switch (qmlCommunication.drawMode()) {
     case DVDrawMode::Anaglyph:
@@ -345,9 +348,12 @@ GLuint DVRenderer::getInterfaceTexture(DVStereoEye::Type eye) const {
     return renderFBO->textures()[qmlCommunication.swapEyes() ? 1-eye : eye];
 }
 
+const DVRenderState& DVRenderer::frameState() const {
+    return m_frameState;
+}
+
 QSGTexture* DVRenderer::getCurrentTexture(QRectF& left, QRectF& right) {
-    getTextureRects(left, right, qmlCommunication.openImageTexture(),
-                    folderListing.currentFileStereoSwap(), folderListing.currentFileStereoMode());
+    getTextureRects(left, right, qmlCommunication.openImageTexture(), m_frameState.stereoSwap, m_frameState.stereoMode);
 
     return qmlCommunication.openImageTexture();
 }
@@ -434,7 +440,7 @@ void DVRenderer::renderStandardQuad() {
 void DVRenderer::doStandardSetup() {
     QOpenGLExtraFunctions* f = openglContext()->extraFunctions();
 
-    if (qmlCommunication.openImageTexture() && folderListing.isCurrentFileSurround()) {
+    if (qmlCommunication.openImageTexture() && m_frameState.surround) {
         f->glViewport(0, 0, qmlSize.width(), qmlSize.height());
 
         f->glEnable(GL_BLEND);
@@ -0,0 +1,144 @@
+#include "dvstereodetector.hpp"
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DV_SAD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DV_SAD_NEON
+#endif
+
+namespace {
+/* Frames are reduced to this, so each half is 64 pixels across or down. */
+constexpr int sampleWidth = 128;
+constexpr int sampleHeight = 128;
+
+/* How many sample pixels the views may be shifted against each other horizontally. */
+constexpr int maxShift = 4;
+/* Columns left out at both sides of each half (or quarter), so that shifting never reads into the next one or past the edge.
+ * What's left is a multiple of 16 bytes across. */
+constexpr int margin = 8;
+
+/* If even the halves that don't match differ by less than this on average, the frame is too flat to tell anything from. */
+constexpr qreal minDetail = 4.0;
+
+/* Side-by-side frames at least this wide (or top/bottom frames at most this tall) have halves with a normal aspect ratio.
+ * Anything else has its halves squeezed to fit a normal frame. */
+constexpr qreal fullSideBySideAspect = 2.5;
+constexpr qreal fullTopBottomAspect = 1.2;
+
+/* The average difference per pixel between the region of size at a and the one at b, with whichever horizontal shift matches best. */
+qreal compareRegions(const QImage& sample, const QPoint& a, const QPoint& b, const QSize& size) {
+    quint64 best = std::numeric_limits<quint64>::max();
+
+    for (int shift = -maxShift; shift <= maxShift; ++shift) {
+        quint64 total = 0;
+
+        for (int y = 0; y < size.height(); ++y)
+            total += DVStereoDetector::sad(sample.constScanLine(a.y() + y) + a.x() + shift, sample.constScanLine(b.y() + y) + b.x(), size.width());
+
+        best = qMin(best, total);
+    }
+
+    return qreal(best) / (size.width() * size.height());
+}
+}
+
+constexpr qreal DVStereoDetector::minConfidence;
+
+DVStereoDetector::DVStereoDetector() : sideBySideDifference(0.0), topBottomDifference(0.0), sideBySideBaseline(0.0), topBottomBaseline(0.0),
+    frames(0) { }
+
+void DVStereoDetector::addFrame(const QImage& frame) {
+    if (frame.isNull()) return;
+
+    /* Smooth scaling averages the pixels together, which also evens out noise and compression artifacts. */
+    const QImage sample = frame.scaled(sampleWidth, sampleHeight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                               .convertToFormat(QImage::Format_Grayscale8);
+
+    const qreal sideBySide = compareRegions(sample, QPoint(margin, 0), QPoint(sampleWidth / 2 + margin, 0),
+                                            QSize(sampleWidth / 2 - margin * 2, sampleHeight));
+    const qreal topBottom = compareRegions(sample, QPoint(margin, 0), QPoint(margin, sampleHeight / 2),
+                                           QSize(sampleWidth - margin * 2, sampleHeight / 2));
+
+    if (qMax(sideBySide, topBottom) < minDetail) return;
+
+    /* The first quarter against the second and the third against the fourth, so each comparison stays within one half. */
+    const QSize quarterAcross(sampleWidth / 4 - margin * 2, sampleHeight);
+    const qreal sideBySideQuarters = (compareRegions(sample, QPoint(margin, 0), QPoint(sampleWidth / 4 + margin, 0), quarterAcross) +
+                                      compareRegions(sample, QPoint(sampleWidth / 2 + margin, 0), QPoint(sampleWidth * 3 / 4 + margin, 0),
+                                                     quarterAcross)) / 2.0;
+
+    const QSize quarterDown(sampleWidth - margin * 2, sampleHeight / 4);
+    const qreal topBottomQuarters = (compareRegions(sample, QPoint(margin, 0), QPoint(margin, sampleHeight / 4), quarterDown) +
+                                     compareRegions(sample, QPoint(margin, sampleHeight / 2), QPoint(margin, sampleHeight * 3 / 4),
+                                                    quarterDown)) / 2.0;
+
+    sideBySideDifference += sideBySide;
+    topBottomDifference += topBottom;
+    sideBySideBaseline += sideBySideQuarters;
+    topBottomBaseline += topBottomQuarters;
+    ++frames;
+}
+
+int DVStereoDetector::usableFrames() const {
+    return frames;
+}
+
+bool DVStereoDetector::result(const QSize& mediaSize, DVSourceMode::Type& mode, qreal& confidence) const {
+    if (frames == 0) return false;
+
+    /* Without a size, assume the more common squeezed layouts. */
+    const qreal aspect = mediaSize.isEmpty() ? 0.0 : qreal(mediaSize.width()) / mediaSize.height();
+
+    /* The halves that match have to beat both the other pair and what they would differ by in a mono frame. */
+    qreal difference, reference;
+
+    if (sideBySideDifference <= topBottomDifference) {
+        mode = aspect >= fullSideBySideAspect ? DVSourceMode::SideBySide : DVSourceMode::SideBySideAnamorphic;
+        difference = sideBySideDifference;
+        reference = qMin(topBottomDifference, sideBySideBaseline);
+    } else {
+        mode = aspect > 0.0 && aspect <= fullTopBottomAspect ? DVSourceMode::TopBottom : DVSourceMode::TopBottomAnamorphic;
+        difference = topBottomDifference;
+        reference = qMin(sideBySideDifference, topBottomBaseline);
+    }
+
+    /* Flat quarters say nothing either way. */
+    if (reference <= 0.0) return false;
+
+    confidence = 1.0 - difference / reference;
+
+    /* No more alike than the halves of a mono frame, so probably mono. */
+    return confidence > 0.0;
+}
+
+quint32 DVStereoDetector::sad(const uchar* a, const uchar* b, int length) {
+    quint32 total = 0;
+    int i = 0;
+
+#if defined(DV_SAD_SSE2)
+    __m128i sum = _mm_setzero_si128();
+
+    for (; i + 16 <= length; i += 16)
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+
+    /* Each 64 bit half holds the sum for 8 of the bytes. */
+    total = quint32(_mm_cvtsi128_si32(sum)) + quint32(_mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#elif defined(DV_SAD_NEON)
+    uint32x4_t sum = vdupq_n_u32(0);
+
+    /* Widened in steps so that no lane can overflow. */
+    for (; i + 16 <= length; i += 16)
+        sum = vpadalq_u16(sum, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+
+    total = vgetq_lane_u32(sum, 0) + vgetq_lane_u32(sum, 1) + vgetq_lane_u32(sum, 2) + vgetq_lane_u32(sum, 3);
+#endif
+
+    for (; i < length; ++i)
+        total += quint32(qAbs(int(a[i]) - int(b[i])));
+
+    return total;
+}
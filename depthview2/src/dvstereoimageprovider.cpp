@@ -0,0 +1,13 @@
+#include "dvstereoimageprovider.hpp"
+#include "dvimageprefetcher.hpp"
+
+DVStereoImageProvider::DVStereoImageProvider(QSharedPointer<DVImagePrefetcher> p) :
+    QQuickImageProvider(QQmlImageProviderBase::Image, QQmlImageProviderBase::ForceAsynchronousImageLoading), prefetcher(p) { }
+
+QImage DVStereoImageProvider::requestImage(const QString& id, QSize* size, const QSize& requestedSize) {
+    /* Only full size images are prefetched, anything else is just decoded directly. */
+    if (!requestedSize.isValid())
+        return prefetcher->image(id, size);
+
+    return DVImagePrefetcher::decode(id, requestedSize, size);
+}
@@ -0,0 +1,220 @@
+#include "dvstoragemonitor.hpp"
+#include <QStorageInfo>
+#include <QFile>
+#include <QDir>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QWaitCondition>
+#include <thread>
+
+#if defined(Q_OS_DARWIN) || defined(Q_OS_BSD4)
+#include <sys/mount.h>
+#endif
+
+namespace {
+/* How long a volume gets to respond before it's listed without its details. */
+constexpr unsigned long statTimeoutMs = 2000;
+
+#if defined(Q_OS_LINUX)
+/* Spaces and such in the mount table are escaped as octal, e.g. "\040". */
+QString unescapeMountField(const QByteArray& field) {
+    QByteArray result;
+
+    for (int i = 0; i < field.size(); ++i) {
+        if (field[i] == '\\' && i + 3 < field.size()) {
+            result += char(field.mid(i + 1, 3).toInt(nullptr, 8));
+            i += 3;
+        } else {
+            result += field[i];
+        }
+    }
+
+    return QString::fromLocal8Bit(result);
+}
+
+/* Filesystems that don't store any files. */
+bool isPseudoFs(const QString& rootPath, const QByteArray& type) {
+    static const QList<QByteArray> pseudoTypes = {"autofs", "binfmt_misc", "bpf", "cgroup", "cgroup2", "configfs", "debugfs",
+                                                  "devpts", "devtmpfs", "fusectl", "hugetlbfs", "mqueue", "proc", "pstore",
+                                                  "rpc_pipefs", "securityfs", "sysfs", "tracefs"};
+
+    return pseudoTypes.contains(type) || rootPath.startsWith("/dev") || rootPath.startsWith("/proc") ||
+           rootPath.startsWith("/sys") || rootPath.startsWith("/run") || rootPath.startsWith("/var/run");
+}
+#endif
+}
+
+struct DVStorageMonitor::VolumeStat {
+    QMutex lock;
+    QWaitCondition done;
+    bool finished = false;
+
+    QString displayName;
+    qint64 bytesTotal = 0;
+};
+
+DVStorageMonitor::DVStorageMonitor() : mountTable(nullptr), pollTimer(nullptr) { }
+
+QStringList DVStorageMonitor::paths() const {
+    QMutexLocker locker(&lock);
+    return m_paths;
+}
+
+void DVStorageMonitor::start() {
+    if (!watchMountTable()) {
+        pollTimer = new QTimer(this);
+        connect(pollTimer, &QTimer::timeout, this, &DVStorageMonitor::refresh);
+        pollTimer->start(8000);
+    }
+
+    refresh();
+}
+
+bool DVStorageMonitor::watchMountTable() {
+#if defined(Q_OS_LINUX)
+    /* The kernel flags the mount table as an exceptional condition whenever something is mounted or unmounted. */
+    mountTable = new QFile("/proc/self/mounts", this);
+
+    if (!mountTable->open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open the mount table, falling back to polling for drives!");
+        return false;
+    }
+
+    QSocketNotifier* notifier = new QSocketNotifier(mountTable->handle(), QSocketNotifier::Exception, this);
+    /* activated() is overloaded (and private) in newer Qt versions, so it can only be connected to by name. */
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(refresh()));
+
+    return true;
+#elif defined(Q_OS_MACOS)
+    /* Every mounted volume gets a directory here. */
+    QFileSystemWatcher* watcher = new QFileSystemWatcher(QStringList("/Volumes"), this);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &DVStorageMonitor::refresh);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DVStorageMonitor::refresh() {
+    const QStringList volumes = listVolumes();
+
+    {
+        QMutexLocker locker(&lock);
+
+        if (volumes == m_paths)
+            return;
+
+        m_paths = volumes;
+    }
+
+    emit pathsChanged();
+}
+
+bool DVStorageMonitor::statVolume(const QString& rootPath, QString& displayName, qint64& bytesTotal) {
+    std::shared_ptr<VolumeStat> stat = hungVolumes.value(rootPath);
+
+    /* Don't pile up more threads on a volume that still hasn't answered. */
+    if (!stat) {
+        stat = std::make_shared<VolumeStat>();
+
+        /* A stat on a dead network share can block in the kernel indefinitely, so it gets a thread that is never waited on. */
+        std::thread([stat, rootPath]() {
+            QStorageInfo info(rootPath);
+
+            QMutexLocker locker(&stat->lock);
+            stat->displayName = info.displayName();
+            stat->bytesTotal = info.bytesTotal();
+            stat->finished = true;
+            stat->done.wakeAll();
+        }).detach();
+    }
+
+    QMutexLocker locker(&stat->lock);
+
+    if (!stat->finished && !stat->done.wait(&stat->lock, statTimeoutMs)) {
+        if (!hungVolumes.contains(rootPath))
+            qWarning("\"%s\" isn't responding!", qPrintable(rootPath));
+
+        hungVolumes.insert(rootPath, stat);
+        return false;
+    }
+
+    hungVolumes.remove(rootPath);
+
+    displayName = stat->displayName;
+    bytesTotal = stat->bytesTotal;
+    return true;
+}
+
+QStringList DVStorageMonitor::listVolumes() {
+    QStringList paths;
+
+    /* QStorageInfo::mountedVolumes() stats every volume with no way to time out,
+     * so the volumes are listed without touching them and then each one is checked with statVolume(). */
+#if defined(Q_OS_LINUX)
+    QFile mounts("/proc/self/mounts");
+
+    if (!mounts.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to read the mount table! %s", qPrintable(mounts.errorString()));
+        return paths;
+    }
+
+    for (const QByteArray& line : mounts.readAll().split('\n')) {
+        /* "<device> <root path> <type> <options> <dump> <pass>" */
+        const QList<QByteArray> fields = line.split(' ');
+        if (fields.size() < 3) continue;
+
+        const QString device = unescapeMountField(fields[0]);
+        const QString rootPath = unescapeMountField(fields[1]);
+
+        /* Ignore tmpfs and run filesystems on Linux. */
+        if (device == "tmpfs" || device == "run" || isPseudoFs(rootPath, fields[2]))
+            continue;
+
+#if defined(Q_OS_ANDROID)
+        /* In my experience anything that doesn't have "storage" or "sdcard" in it on Android is useless. */
+        if (!rootPath.contains("storage") && !rootPath.contains("sdcard"))
+            continue;
+#endif
+
+        QString displayName = rootPath;
+        qint64 bytesTotal = 0;
+
+        /* If it didn't respond it's still listed, it may just be slow. */
+        statVolume(rootPath, displayName, bytesTotal);
+
+        paths.append(rootPath + ';' + displayName + ";" + QString::number(bytesTotal));
+    }
+#else
+    QStringList rootPaths;
+
+#if defined(Q_OS_DARWIN) || defined(Q_OS_BSD4)
+    /* MNT_NOWAIT returns what the kernel already knows instead of asking every filesystem. */
+    struct statfs* mounts = nullptr;
+    const int count = getmntinfo(&mounts, MNT_NOWAIT);
+
+    for (int i = 0; i < count; ++i)
+        rootPaths.append(QFile::decodeName(mounts[i].f_mntonname));
+#else
+    /* Drive letters on Windows, which come from a bitmask without asking the drives anything. */
+    for (const QFileInfo& drive : QDir::drives())
+        rootPaths.append(drive.absoluteFilePath());
+#endif
+
+    for (const QString& rootPath : rootPaths) {
+        QString displayName = rootPath;
+        qint64 bytesTotal = 0;
+
+        /* Volumes that have no size (devfs and the like, or an empty card reader) are left out like mountedVolumes() does,
+         * but ones that didn't respond are still listed since they may just be slow. */
+        if (statVolume(rootPath, displayName, bytesTotal) && bytesTotal == 0)
+            continue;
+
+        paths.append(rootPath + ';' + displayName + ";" + QString::number(bytesTotal));
+    }
+#endif
+
+    return paths;
+}
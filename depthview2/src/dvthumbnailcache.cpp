@@ -0,0 +1,192 @@
+#include "dvthumbnailcache.hpp"
+#include "dvfunctiontask.hpp"
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QFile>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QImageWriter>
+#include <QImageReader>
+#include <QDir>
+#include <QDirIterator>
+#include <algorithm>
+
+namespace {
+/* Enough for a few screens worth of thumbnails. */
+constexpr int memoryCacheKB = 64 * 1024;
+
+/* Thumbnails are small and only ever shown scaled down, so a fairly low quality is fine. */
+constexpr int jpegQuality = 85;
+
+/* The size of the full image is stored in the file along with the thumbnail. */
+const QString originalSizeKey = "DVOriginalSize";
+
+/* Falls back to the size of the thumbnail itself if the original size wasn't stored. */
+QSize storedOriginalSize(const QImage& image) {
+    const QStringList dimensions = image.text(originalSizeKey).split('x');
+
+    return dimensions.size() == 2 ? QSize(dimensions[0].toInt(), dimensions[1].toInt()) : image.size();
+}
+
+int imageCost(const QImage& image) {
+    return qMax(1, image.bytesPerLine() * image.height() / 1024);
+}
+
+/* Pruning goes this far under the limit, so that it isn't started again by the next few thumbnails. */
+constexpr int pruneTargetPercent = 90;
+}
+
+DVThumbnailCache::DVThumbnailCache(const QString& dir, qint64 maxBytes) : cacheDir(dir), maxDiskBytes(maxBytes),
+    diskBytes(0), pruning(true) {
+    memoryCache.setMaxCost(memoryCacheKB);
+    prunePool.setMaxThreadCount(1);
+
+    if (!QDir().mkpath(cacheDir)) {
+        qWarning("Unable to create thumbnail cache dir \"%s\"!", qPrintable(cacheDir));
+        return;
+    }
+
+    /* Adding up a large cache takes a while, so it shouldn't hold up startup. */
+    prunePool.start(new DVFunctionTask([this]() { prune(); }));
+}
+
+void DVThumbnailCache::prune() {
+    QList<QFileInfo> files;
+    qint64 totalBytes = 0;
+
+    /* Only thumbnails are touched, not the temporary files of ones being written. */
+    QDirIterator it(cacheDir, QStringList() << "*.jpg", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        files.append(it.fileInfo());
+        totalBytes += it.fileInfo().size();
+    }
+
+    if (totalBytes > maxDiskBytes) {
+        /* find() touches the thumbnails it reads, so the oldest are the least recently used. */
+        std::sort(files.begin(), files.end(), [](const QFileInfo& a, const QFileInfo& b) {
+            return a.lastModified() < b.lastModified();
+        });
+
+        const qint64 targetBytes = maxDiskBytes / 100 * pruneTargetPercent;
+
+        int removed = 0;
+        for (const QFileInfo& file : files) {
+            if (totalBytes <= targetBytes) break;
+
+            if (QFile::remove(file.filePath())) {
+                totalBytes -= file.size();
+                ++removed;
+            }
+        }
+
+        qDebug("Removed %i old thumbnails from the cache.", removed);
+    }
+
+    /* Anything written while the dir was being listed may be missed, that just makes the next prune a little late. */
+    QMutexLocker locker(&diskLock);
+    diskBytes = totalBytes;
+    pruning = false;
+}
+
+QByteArray DVThumbnailCache::key(const QFileInfo& file, const QSize& requestedSize) const {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    hash.addData(file.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(file.size()) + '|' +
+                 QByteArray::number(file.lastModified().toMSecsSinceEpoch()) + '|' +
+                 QByteArray::number(requestedSize.width()) + 'x' + QByteArray::number(requestedSize.height()));
+
+    return hash.result().toHex();
+}
+
+QString DVThumbnailCache::pathForKey(const QByteArray& key) const {
+    /* Split into subdirectories by the first two characters, so no single directory gets too large. */
+    return cacheDir + '/' + key.left(2) + '/' + key.mid(2) + ".jpg";
+}
+
+QImage DVThumbnailCache::find(const QFileInfo& file, const QSize& requestedSize, QSize* originalSize) {
+    const QByteArray k = key(file, requestedSize);
+
+    {
+        QMutexLocker locker(&memoryLock);
+
+        if (const QImage* image = memoryCache.object(k)) {
+            if (originalSize)
+                *originalSize = storedOriginalSize(*image);
+
+            return *image;
+        }
+    }
+
+    const QString path = pathForKey(k);
+    QImageReader reader(path, "jpg");
+
+    /* Not being there is the normal case for a miss, so don't warn about it. */
+    if (!reader.canRead())
+        return QImage();
+
+    QImage image = reader.read();
+
+    if (image.isNull()) {
+        qWarning("Unable to read cached thumbnail for \"%s\"! %s", qPrintable(file.filePath()), qPrintable(reader.errorString()));
+        return image;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    /* Mark it as used so that it's pruned last. (Older versions can't set the time, so there the oldest thumbnails go first.) */
+    QFile stored(path);
+    if (stored.open(QIODevice::ReadWrite))
+        stored.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#endif
+
+    if (originalSize)
+        *originalSize = storedOriginalSize(image);
+
+    QMutexLocker locker(&memoryLock);
+    memoryCache.insert(k, new QImage(image), imageCost(image));
+
+    return image;
+}
+
+void DVThumbnailCache::insert(const QFileInfo& file, const QSize& requestedSize, const QImage& thumbnail, const QSize& originalSize) {
+    if (thumbnail.isNull()) return;
+
+    const QByteArray k = key(file, requestedSize);
+
+    QImage image = thumbnail;
+    image.setText(originalSizeKey, QString("%1x%2").arg(originalSize.width()).arg(originalSize.height()));
+
+    {
+        QMutexLocker locker(&memoryLock);
+        memoryCache.insert(k, new QImage(image), imageCost(image));
+    }
+
+    const QString path = pathForKey(k);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    /* Write to a temporary file first, so a thumbnail being read from another thread is never half written. */
+    QSaveFile output(path);
+
+    if (!output.open(QIODevice::WriteOnly)) {
+        qWarning("Unable to open \"%s\" to cache thumbnail! %s", qPrintable(path), qPrintable(output.errorString()));
+        return;
+    }
+
+    QImageWriter writer(&output, "jpg");
+    writer.setQuality(jpegQuality);
+
+    /* JPEG has no alpha channel. */
+    if (!writer.write(image.hasAlphaChannel() ? image.convertToFormat(QImage::Format_RGB32) : image) || !output.commit()) {
+        qWarning("Unable to write cached thumbnail \"%s\"! %s", qPrintable(path), qPrintable(writer.errorString()));
+        return;
+    }
+
+    QMutexLocker locker(&diskLock);
+    diskBytes += QFileInfo(path).size();
+
+    if (!pruning && diskBytes > maxDiskBytes) {
+        pruning = true;
+        prunePool.start(new DVFunctionTask([this]() { prune(); }));
+    }
+}
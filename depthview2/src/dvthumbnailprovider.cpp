@@ -1,65 +1,129 @@
 #include "dvthumbnailprovider.hpp"
+#include "dvthumbnailresponse.hpp"
+#include "dvthumbnailcache.hpp"
+#include "dvfunctiontask.hpp"
+#include "dvthumbnailviewport.hpp"
+#include "dvkeyframeextractor.hpp"
+#include <QFileInfo>
 #include <QThread>
 
-DVThumbnailProvider::DVThumbnailProvider() : QQuickImageProvider(QQmlImageProviderBase::Texture) {
-    frameExtractor.setAutoExtract(false);
-    frameExtractor.setAsync(false);
+namespace {
+/* Past this many waiting requests the oldest one that is out of view is dropped. */
+constexpr int maxQueuedRequests = 128;
+}
+
+DVThumbnailProvider::DVThumbnailProvider(const QSharedPointer<DVThumbnailCache>& thumbnailCache, const QSharedPointer<DVThumbnailViewport>& thumbnailViewport,
+                                         qreal position) : cache(thumbnailCache), viewport(thumbnailViewport), thumbnailPosition(position) {
+    /* Decoding is CPU bound, so one worker per core. */
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+    /* Reading from the cache is mostly waiting on the disk, a couple of threads is plenty. */
+    cachePool.setMaxThreadCount(2);
+}
+
+DVThumbnailProvider::~DVThumbnailProvider() {
+    /* Lookups may still add to the queue. */
+    cachePool.waitForDone();
+
+    /* The engine still needs to hear back about anything that never got started. */
+    {
+        QMutexLocker locker(&queueLock);
+        while (!queue.isEmpty())
+            queue.takeFirst()->finish(QImage(), "Thumbnail provider destroyed.");
+    }
+
+    pool.waitForDone();
+}
 
-    /* We don't need it to be precise, and making it large reduces the chance that extraction will fail. */
-    frameExtractor.setPrecision(500);
+QQuickImageResponse* DVThumbnailProvider::requestImageResponse(const QString& id, const QSize& requestedSize) {
+    DVThumbnailResponse* response = new DVThumbnailResponse(id, requestedSize);
 
-    /* TODO - Set dynamically based on video length... */
-    frameExtractor.setPosition(60000);
+    /* The engine only starts listening for finished() once this returns, so even cached thumbnails are finished from another thread. */
+    cachePool.start(new DVFunctionTask([this, response]() { lookup(response); }));
 
-    connect(&frameExtractor, &QtAV::VideoFrameExtractor::frameExtracted, this, &DVThumbnailProvider::frameReceived, Qt::DirectConnection);
-    connect(&frameExtractor, &QtAV::VideoFrameExtractor::error, this, &DVThumbnailProvider::frameError, Qt::DirectConnection);
+    return response;
 }
 
-QQuickTextureFactory* DVThumbnailProvider::requestTexture(const QString& id, QSize* size, const QSize& requestedSize) {
-    /* This only works for one thumbnail at a time. */
-    QMutexLocker locker(&waitReady);
+void DVThumbnailProvider::lookup(DVThumbnailResponse* response) {
+    QImage image = cache->find(QFileInfo(response->fileId()), response->size());
+
+    if (!image.isNull()) {
+        response->finish(image);
+        return;
+    }
 
-    qDebug("Thumbnail load started for \"%s\".", qPrintable(id));
+    QMutexLocker locker(&queueLock);
 
-    /* Reset the variables. */
-    image = QImage();
-    originalFrameSize = QSize();
+    removeCancelledLocked();
 
-    requestedFrameSize = requestedSize;
-    frameExtractor.setSource(id);
+    queue.append(response);
 
-    tryLoadThumbnail(4, id);
+    if (queue.size() > maxQueuedRequests) {
+        /* Anything that is still near the view is kept, a delegate that's shown won't ask again if its request fails. */
+        for (int i = 0; i < queue.size(); ++i) {
+            if (viewport->priority(queue[i]->fileId()) == DVThumbnailViewport::Offscreen) {
+                DVThumbnailResponse* dropped = queue.takeAt(i);
+                qDebug("Too many thumbnails queued, dropping \"%s\".", qPrintable(dropped->fileId()));
+                dropped->finish(QImage(), "Dropped from the thumbnail queue.");
+                break;
+            }
+        }
+    }
 
-    if (size)
-        *size = originalFrameSize;
+    /* Each task takes whatever is most important in the queue, which may not be the request it was started for. */
+    pool.start(new DVFunctionTask([this]() { processNext(); }));
+}
 
-    return QQuickTextureFactory::textureFactoryForImage(image);
+void DVThumbnailProvider::removeCancelledLocked() {
+    for (int i = 0; i < queue.size();) {
+        if (queue[i]->isCancelled())
+            /* The engine still needs finished() to clean up. */
+            queue.takeAt(i)->finish(QImage(), "Cancelled.");
+        else
+            ++i;
+    }
 }
 
-bool DVThumbnailProvider::tryLoadThumbnail(int retries, const QString& id) {
-    hadError = false;
+void DVThumbnailProvider::processNext() {
+    DVThumbnailResponse* response;
+    {
+        QMutexLocker locker(&queueLock);
 
-    frameExtractor.extract();
+        removeCancelledLocked();
 
-    if (!hadError) return true;
+        /* Another task got to it, or it was dropped. */
+        if (queue.isEmpty()) return;
 
-    if (retries > 0) {
-        qDebug("Error loading thumbnail for \"%s\"! Trying %i more times...", qPrintable(id), retries);
-        return tryLoadThumbnail(--retries, id);
+        /* Priorities are checked now rather than when queued, as the view may have scrolled since then. */
+        int best = 0;
+        DVThumbnailViewport::Priority bestPriority = viewport->priority(queue[best]->fileId());
+        for (int i = 1; i < queue.size() && bestPriority != DVThumbnailViewport::Visible; ++i) {
+            const DVThumbnailViewport::Priority priority = viewport->priority(queue[i]->fileId());
+            if (priority < bestPriority) {
+                best = i;
+                bestPriority = priority;
+            }
+        }
+
+        response = queue.takeAt(best);
     }
-    qDebug("Error loading thumbnail for \"%s\"! Giving up.", qPrintable(id));
 
-    return false;
-}
+    /* It may have been cancelled while it was waiting for the lock. */
+    if (response->isCancelled()) {
+        response->finish(QImage(), "Cancelled.");
+        return;
+    }
 
-void DVThumbnailProvider::frameReceived(const QtAV::VideoFrame& frame) {
-    originalFrameSize = frame.size();
-    /* Scale the frame size to fit inside the requested size while maintaining aspect ratio. */
-    image = frame.toImage(QImage::Format_RGB32, originalFrameSize.scaled(requestedFrameSize, Qt::KeepAspectRatio));
+    const QFileInfo file(response->fileId());
 
-    qDebug("Thumbnail for %s loaded.", qPrintable(frameExtractor.source()));
-}
+    QSize originalSize;
+    const QImage image = DVKeyframeExtractor(thumbnailPosition).extract(file.filePath(), response->size(), &originalSize);
+
+    if (image.isNull()) {
+        response->finish(QImage(), "Unable to extract a frame.");
+        return;
+    }
+
+    cache->insert(file, response->size(), image, originalSize);
 
-void DVThumbnailProvider::frameError() {
-    hadError = true;
+    response->finish(image);
 }
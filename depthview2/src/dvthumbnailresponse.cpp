@@ -0,0 +1,35 @@
+#include "dvthumbnailresponse.hpp"
+
+DVThumbnailResponse::DVThumbnailResponse(const QString& id, const QSize& requestedSize)
+    : id(id), requestedSize(requestedSize), cancelled(0) { }
+
+const QString& DVThumbnailResponse::fileId() const {
+    return id;
+}
+
+const QSize& DVThumbnailResponse::size() const {
+    return requestedSize;
+}
+
+bool DVThumbnailResponse::isCancelled() const {
+    return cancelled.loadAcquire();
+}
+
+void DVThumbnailResponse::finish(const QImage& result, const QString& errorMessage) {
+    image = result;
+    error = errorMessage;
+
+    emit finished();
+}
+
+QQuickTextureFactory* DVThumbnailResponse::textureFactory() const {
+    return QQuickTextureFactory::textureFactoryForImage(image);
+}
+
+QString DVThumbnailResponse::errorString() const {
+    return error;
+}
+
+void DVThumbnailResponse::cancel() {
+    cancelled.storeRelease(1);
+}
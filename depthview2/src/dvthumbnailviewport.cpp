@@ -0,0 +1,54 @@
+#include "dvthumbnailviewport.hpp"
+
+DVThumbnailViewport::DVThumbnailViewport() : firstVisible(-1), lastVisible(-1), direction(1) { }
+
+void DVThumbnailViewport::setVisibleRows(int first, int last, const QHash<QString, int>& nearby) {
+    {
+        QMutexLocker locker(&lock);
+        nearbyRows = nearby;
+    }
+
+    const int oldFirst = firstVisible.fetchAndStoreRelaxed(first);
+    lastVisible.storeRelease(last);
+
+    /* Keep the old direction if the view didn't move, e.g. when resizing. */
+    if (first != oldFirst)
+        direction.storeRelease(first > oldFirst ? 1 : -1);
+}
+
+DVThumbnailViewport::Priority DVThumbnailViewport::priority(int row) const {
+    const int first = firstVisible.loadAcquire();
+    const int last = lastVisible.loadAcquire();
+
+    /* Nothing known about the view or the row. */
+    if (row < 0 || first < 0 || last < first)
+        return Ahead;
+
+    if (row >= first && row <= last)
+        return Visible;
+
+    /* Prefetch one screen worth of rows on either side. */
+    const int screen = last - first + 1;
+    const bool below = row > last && row <= last + screen;
+    const bool above = row < first && row >= first - screen;
+
+    if (direction.loadAcquire() > 0 ? below : above)
+        return Ahead;
+    if (below || above)
+        return Behind;
+
+    return Offscreen;
+}
+
+DVThumbnailViewport::Priority DVThumbnailViewport::priority(const QString& path) const {
+    int row;
+    {
+        QMutexLocker locker(&lock);
+        row = nearbyRows.value(path, -1);
+    }
+
+    if (row < 0 && firstVisible.loadAcquire() >= 0)
+        return Offscreen;
+
+    return priority(row);
+}
@@ -0,0 +1,280 @@
+#include "dvvideotranscoder.hpp"
+#include "dvframequeue.hpp"
+#include "dvfunctiontask.hpp"
+#include <QAtomicInt>
+#include <QFile>
+#include <QFileInfo>
+#include <QScopedPointer>
+#include <QThreadPool>
+#include <QtAV/AVDemuxer.h>
+#include <QtAV/AVMuxer.h>
+#include <QtAV/VideoDecoder.h>
+#include <QtAV/VideoEncoder.h>
+#include <QtAV/Packet.h>
+
+namespace {
+/* For containers that don't say. */
+constexpr qreal defaultFrameRate = 25.0;
+
+/* If this many reads in a row fail the file is broken, rather than at the end. */
+constexpr int maxReadErrors = 64;
+/* Decoders can't be holding back more frames than this at the end. */
+constexpr int maxDelayedFrames = 64;
+
+/* The decoded frame, both eyes, the composited image and its YUV copy. */
+constexpr int framesInFlight = 5;
+
+/* 4:2:0 is what every player can handle. */
+constexpr QtAV::VideoFormat::PixelFormat pixelFormat = QtAV::VideoFormat::Format_YUV420P;
+
+typedef DVFrameQueue<QImage> ImageQueue;
+typedef DVFrameQueue<QtAV::VideoFrame> VideoFrameQueue;
+
+bool decodeFrames(QtAV::AVDemuxer& demuxer, QtAV::VideoDecoder& decoder, ImageQueue& output, const QString& file) {
+    /* Everything after this is done on the CPU, so the frame may as well be in the format the compositor wants. */
+    auto push = [&output](const QtAV::VideoFrame& frame) {
+        return output.push(frame.toImage(QImage::Format_RGBA8888));
+    };
+
+    int readErrors = 0;
+
+    while (!demuxer.atEnd()) {
+        if (!demuxer.readFrame()) {
+            if (++readErrors < maxReadErrors) continue;
+
+            qWarning("Unable to read \"%s\" past %.1f seconds!", qPrintable(file), demuxer.packet().pts);
+            return false;
+        }
+        readErrors = 0;
+
+        if (demuxer.stream() != demuxer.videoStream() || !decoder.decode(demuxer.packet()))
+            continue;
+
+        const QtAV::VideoFrame frame = decoder.frame();
+
+        /* The later stages closed the queue, they've given up. */
+        if (frame.isValid() && !push(frame))
+            return true;
+    }
+
+    /* Get the frames the decoder is still holding on to. */
+    for (int i = 0; i < maxDelayedFrames && decoder.decode(QtAV::Packet::createEOF()); ++i) {
+        const QtAV::VideoFrame frame = decoder.frame();
+
+        if (!frame.isValid() || !push(frame))
+            break;
+    }
+
+    return true;
+}
+
+bool convertFrames(const DVCompositor& compositor, DVDrawMode::Type drawMode, DVSourceMode::Type sourceMode, bool swap, qreal frameRate,
+                   ImageQueue& input, VideoFrameQueue& output) {
+    QImage frame;
+
+    for (qint64 frameNumber = 0; input.pop(frame); ++frameNumber) {
+        QImage left, right;
+
+        if (!DVCompositor::splitFrame(frame, sourceMode, swap, left, right))
+            return false;
+
+        QImage image = compositor.compose(left, right, drawMode);
+
+        if (image.isNull())
+            return false;
+
+        /* The chroma of 4:2:0 is shared by blocks of 2x2 pixels, so encoders want even sizes. */
+        if (image.width() % 2 != 0 || image.height() % 2 != 0)
+            image = image.copy(0, 0, image.width() & ~1, image.height() & ~1);
+
+        QtAV::VideoFrame videoFrame = QtAV::VideoFrame(image).to(pixelFormat);
+
+        if (!videoFrame.isValid()) {
+            qWarning("Unable to convert a %ix%i frame for encoding!", image.width(), image.height());
+            return false;
+        }
+
+        /* The encoder's pts comes from the timestamp, which frames made from an image don't have. */
+        videoFrame.setTimestamp(frameNumber / frameRate);
+
+        if (!output.push(videoFrame))
+            return true;
+    }
+
+    return true;
+}
+
+bool encodeFrames(QtAV::VideoEncoder& encoder, QtAV::AVMuxer& muxer, VideoFrameQueue& input, const QString& file) {
+    QtAV::VideoFrame frame;
+
+    while (input.pop(frame)) {
+        /* The size of the output isn't known until the first frame is done. */
+        if (!encoder.isOpen()) {
+            encoder.setWidth(frame.width());
+            encoder.setHeight(frame.height());
+
+            if (!encoder.open()) {
+                qWarning("Unable to open the \"%s\" encoder for \"%s\"!", qPrintable(encoder.codecName()), qPrintable(file));
+                return false;
+            }
+
+            muxer.copyProperties(&encoder);
+
+            if (!muxer.open()) {
+                qWarning("Unable to open \"%s\" to write to!", qPrintable(file));
+                return false;
+            }
+        }
+
+        if (encoder.encode(frame) && !muxer.writeVideo(encoder.encoded())) {
+            qWarning("Unable to write to \"%s\"!", qPrintable(file));
+            return false;
+        }
+    }
+
+    if (!encoder.isOpen()) {
+        qWarning("No frames to encode into \"%s\"!", qPrintable(file));
+        return false;
+    }
+
+    /* Encoders hold frames back to look ahead, encoding nothing gets them out. */
+    for (int i = 0; i < maxDelayedFrames && encoder.encode(); ++i) {
+        if (!muxer.writeVideo(encoder.encoded())) {
+            qWarning("Unable to write to \"%s\"!", qPrintable(file));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* "Movie.mp4" -> "Movie.part.mp4", the container is still chosen by the suffix. */
+QString partialPath(const QString& file) {
+    const QFileInfo info(file);
+
+    return info.path() + '/' + info.completeBaseName() + ".part." + info.suffix();
+}
+}
+
+constexpr int DVVideoTranscoder::queueLength;
+
+DVVideoTranscoder::DVVideoTranscoder() : drawMode(DVDrawMode::SideBySide), sourceMode(DVSourceMode::SideBySide), swap(false),
+    codec("libx264"), bitRate(0) { }
+
+void DVVideoTranscoder::setCompositor(const DVCompositor& c) {
+    compositor = c;
+}
+
+void DVVideoTranscoder::setDrawMode(DVDrawMode::Type mode) {
+    drawMode = mode;
+}
+
+void DVVideoTranscoder::setSourceLayout(DVSourceMode::Type mode, bool swapEyes) {
+    sourceMode = mode;
+    swap = swapEyes;
+}
+
+void DVVideoTranscoder::setCodec(const QString& name) {
+    codec = name;
+}
+
+void DVVideoTranscoder::setBitRate(int bitsPerSecond) {
+    bitRate = bitsPerSecond;
+}
+
+qint64 DVVideoTranscoder::memoryEstimate(const QSize& frameSize) const {
+    /* Squeezed sources have their eyes stretched back out, and the output can be twice the size of an eye. */
+    const qint64 frameBytes = qint64(frameSize.width()) * frameSize.height() * 4 * 2;
+
+    return frameBytes * (queueLength * 2 + framesInFlight);
+}
+
+bool DVVideoTranscoder::transcode(const QString& input, const QString& output) const {
+    QtAV::AVDemuxer demuxer;
+    demuxer.setMedia(input);
+
+    if (!demuxer.load() || demuxer.videoStream() < 0) {
+        qWarning("Unable to open \"%s\" to transcode!", qPrintable(input));
+        return false;
+    }
+
+    /* AVMuxer only makes streams for its encoders, so audio packets can't just be copied across. */
+    if (demuxer.audioStream() >= 0)
+        qWarning("The audio of \"%s\" isn't transcoded, \"%s\" will be silent!", qPrintable(input), qPrintable(output));
+
+    QScopedPointer<QtAV::VideoDecoder> decoder(QtAV::VideoDecoder::create("FFmpeg"));
+    QScopedPointer<QtAV::VideoEncoder> encoder(QtAV::VideoEncoder::create("FFmpeg"));
+
+    if (decoder.isNull() || encoder.isNull()) {
+        qWarning("Unable to create a video decoder and encoder!");
+        return false;
+    }
+
+    decoder->setCodecContext(demuxer.videoCodecContext());
+
+    if (!decoder->open()) {
+        qWarning("Unable to open decoder for \"%s\"!", qPrintable(input));
+        return false;
+    }
+
+    encoder->setCodecName(codec);
+    encoder->setPixelFormat(pixelFormat);
+
+    const qreal frameRate = demuxer.frameRate() > 0.0 ? demuxer.frameRate() : defaultFrameRate;
+    encoder->setFrameRate(frameRate);
+    if (bitRate > 0)
+        encoder->setBitRate(bitRate);
+
+    /* Written under another name first, so that a failed transcode never leaves something that looks finished. */
+    const QString partial = partialPath(output);
+
+    QtAV::AVMuxer muxer;
+    muxer.setMedia(partial);
+
+    ImageQueue decoded(queueLength);
+    VideoFrameQueue converted(queueLength);
+
+    QAtomicInt failed(0);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+
+    /* Each stage closes the queues on both sides when it's done or gives up, which wakes up and finishes the stages next to it. */
+    pool.start(new DVFunctionTask([&]() {
+        if (!decodeFrames(demuxer, *decoder, decoded, input))
+            failed.ref();
+
+        decoded.close();
+    }));
+    pool.start(new DVFunctionTask([&]() {
+        if (!convertFrames(compositor, drawMode, sourceMode, swap, frameRate, decoded, converted))
+            failed.ref();
+
+        decoded.close();
+        converted.close();
+    }));
+
+    /* Encoding is the slowest stage, it gets this thread rather than waiting on it. */
+    if (!encodeFrames(*encoder, muxer, converted, output))
+        failed.ref();
+
+    converted.close();
+    pool.waitForDone();
+
+    encoder->close();
+    if (muxer.isOpen())
+        muxer.close();
+
+    if (failed.load() != 0) {
+        QFile::remove(partial);
+        return false;
+    }
+
+    if ((QFile::exists(output) && !QFile::remove(output)) || !QFile::rename(partial, output)) {
+        qWarning("Unable to replace \"%s\"!", qPrintable(output));
+        QFile::remove(partial);
+        return false;
+    }
+
+    return true;
+}
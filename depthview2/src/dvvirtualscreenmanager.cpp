@@ -385,7 +385,8 @@ QString DVVirtualScreenManager::errorString() const {
 }
 
 bool DVVirtualScreenManager::isCurrentFileSurround() const {
-    return folderListing.isCurrentFileSurround();
+    /* Only called while rendering, so use the same value as the rest of the frame. */
+    return renderer->frameState().surround;
 }
 qreal DVVirtualScreenManager::surroundPan() const {
     return qmlCommunication.surroundPan().x();
@@ -4,6 +4,10 @@
 #include "dvfolderlisting.hpp"
 #include "dvrenderer.hpp"
 #include "dvthumbnailprovider.hpp"
+#include "dvthumbnailcache.hpp"
+#include "dvimagethumbnailprovider.hpp"
+#include "dvstereoimageprovider.hpp"
+#include "dvimageprefetcher.hpp"
 #include "dvpluginmanager.hpp"
 #include "dvfilevalidator.hpp"
 #include "dvconfig.hpp"
@@ -16,6 +20,7 @@
 #include <QCommandLineParser>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QStandardPaths>
 #include <QSqlDatabase>
 #include <AVPlayer.h>
 #include <VideoCapture.h>
@@ -29,7 +34,7 @@
 #endif
 
 DVWindowHook::DVWindowHook(QQmlApplicationEngine* engine) : QObject(engine), settings(SETTINGS_ARGS) {
-    /* Use the path of the settings file to get the path for the database. */
+    /* Use the path of the settings file to get the path for the database. (File metadata has its own connection, this one is for plugins.) */
     QString path = settings.fileName();
     path.remove(path.lastIndexOf('.'), path.length()).append(".db");
     QSqlDatabase dataDB = QSqlDatabase::addDatabase("QSQLITE");
@@ -52,10 +57,32 @@ DVWindowHook::DVWindowHook(QQmlApplicationEngine* engine) : QObject(engine), set
     engine->rootContext()->setContextProperty("PluginManager", pluginManager);
     engine->rootContext()->setContextProperty("VRManager", renderer->vrManager);
 
-    engine->addImageProvider("video", new DVThumbnailProvider);
+#ifdef DV_PORTABLE
+    /* Portable builds keep everything next to the application executable. */
+    const QString thumbnailDir = QApplication::applicationDirPath() + "/thumbnails";
+#else
+    const QString thumbnailDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+#endif
+    /* Shared by all of the thumbnail providers, which are owned (and deleted) by the engine. */
+    QSharedPointer<DVThumbnailCache> thumbnailCache(new DVThumbnailCache(thumbnailDir,
+                                                                         qMax(1, settings.value("ThumbnailCacheMB", 512).toInt()) * qint64(1024 * 1024)));
+
+    /* Where in each video (as a fraction of its length) the thumbnail is taken from. */
+    engine->addImageProvider("video", new DVThumbnailProvider(thumbnailCache, folderListing->thumbnailViewport,
+                                                              settings.value("ThumbnailPosition", 0.2).toReal()));
+    engine->addImageProvider("thumbnail", new DVImageThumbnailProvider(thumbnailCache));
+
+    /* Decodes the images around the current one while it's being looked at. */
+    QSharedPointer<DVImagePrefetcher> prefetcher(new DVImagePrefetcher(settings, *folderListing));
+    connect(folderListing, &DVFolderListing::currentFileChanged, prefetcher.data(), &DVImagePrefetcher::prefetch);
+    /* Files opened in another dir only have neighbours once that dir has been listed. */
+    connect(folderListing, &DVFolderListing::scanningChanged, prefetcher.data(), &DVImagePrefetcher::prefetch);
+    engine->addImageProvider("stereo", new DVStereoImageProvider(prefetcher));
 
     qmlRegisterUncreatableType<DVDrawMode>(DV_URI_VERSION, "DrawMode", "Only for enum values.");
     qmlRegisterUncreatableType<DVSourceMode>(DV_URI_VERSION, "SourceMode", "Only for enum values.");
+    qmlRegisterUncreatableType<DVSortMode>(DV_URI_VERSION, "SortMode", "Only for enum values.");
+    qmlRegisterUncreatableType<DVFileFilter>(DV_URI_VERSION, "FileFilter", "Only for enum values.");
     qmlRegisterType<DVFileValidator>(DV_URI_VERSION, "FileValidator");
     qRegisterMetaType<DVFolderListing*>();
 
@@ -95,7 +122,8 @@ DVWindowHook::DVWindowHook(QQmlApplicationEngine* engine) : QObject(engine), set
     if (settings.contains("SnapshotDir"))
         player->videoCapture()->setCaptureDir(settings.value("SnapshotDir").toString());
 
-    connect(player->videoCapture(), &QtAV::VideoCapture::saved, this, &DVWindowHook::imageCaptured, Qt::DirectConnection);
+    /* The file listing is only used from the GUI thread, so handle captures there rather than on the capture thread. */
+    connect(player->videoCapture(), &QtAV::VideoCapture::saved, this, &DVWindowHook::imageCaptured, Qt::QueuedConnection);
     connect(folderListing, &DVFolderListing::snapshotDirChanged, player->videoCapture(), &QtAV::VideoCapture::setCaptureDir);
 
     window->installEventFilter(this);
@@ -139,9 +167,9 @@ void DVWindowHook::updateTitle() {
 void DVWindowHook::imageCaptured(const QString& filename) {
     QFileInfo info(filename);
     /* Copy the database info for the current file to the new file (excluding audio track because this is an image). */
-    folderListing->updateRecordForFile(info, "stereoMode", folderListing->currentFileStereoMode());
-    folderListing->updateRecordForFile(info, "stereoSwap", folderListing->currentFileStereoSwap());
-    folderListing->updateRecordForFile(info, "surround", folderListing->isCurrentFileSurround());
+    folderListing->updateRecordForFile(info, {{"stereoMode", folderListing->currentFileStereoMode()},
+                                              {"stereoSwap", folderListing->currentFileStereoSwap()},
+                                              {"surround", folderListing->isCurrentFileSurround()}});
 }
 
 bool DVWindowHook::eventFilter(QObject*, QEvent* e) {
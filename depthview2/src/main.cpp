@@ -6,20 +6,93 @@
 #include "version.hpp"
 #include "dvwindowhook.hpp"
 #include "dvqmlcommunication.hpp"
+#include "dvbatchexporter.hpp"
+
+namespace {
+/* Exporting doesn't open a window, so it must not need a display either. This has to be known before the application is made. */
+bool exportRequested(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i)
+        if (qstrcmp(argv[i], "-x") == 0 || qstrcmp(argv[i], "--export") == 0 || qstrncmp(argv[i], "--export=", 9) == 0)
+            return true;
+
+    return false;
+}
+
+int runExport(const QCommandLineParser& parser) {
+    DVBatchExporter::Options options;
+    options.outputDir = parser.value("export");
+
+    if (parser.isSet("output-mode")) {
+        const int mode = DVDrawMode::fromString(parser.value("output-mode").toLatin1().data());
+
+        if (mode == -1 || mode == DVDrawMode::VirtualReality) {
+            qWarning("Invalid output mode \"%s\" passed to \"--output-mode\" argument!", qPrintable(parser.value("output-mode")));
+            return 1;
+        }
+        options.drawMode = DVDrawMode::Type(mode);
+    }
+
+    if (parser.isSet("source-mode")) {
+        options.sourceMode = DVSourceMode::fromString(parser.value("source-mode").toLatin1().data());
+
+        if (options.sourceMode == -1) {
+            qWarning("Invalid source mode \"%s\" passed to \"--source-mode\" argument!", qPrintable(parser.value("source-mode")));
+            return 1;
+        }
+    }
+
+    options.swap = parser.isSet("swap");
+    options.anamorphic = parser.isSet("anamorphic");
+    options.mirrorLeft = parser.isSet("mirror-left");
+    options.mirrorRight = parser.isSet("mirror-right");
+
+    if (parser.isSet("grey"))
+        options.greyFacL = options.greyFacR = qBound(0.0, parser.value("grey").toDouble(), 1.0);
+    if (parser.isSet("format"))
+        options.format = parser.value("format").toLatin1();
+    if (parser.isSet("quality"))
+        options.quality = parser.value("quality").toInt();
+    if (parser.isSet("video-format"))
+        options.videoFormat = parser.value("video-format").toLatin1();
+    if (parser.isSet("video-codec"))
+        options.videoCodec = parser.value("video-codec");
+    if (parser.isSet("video-bitrate"))
+        options.videoBitRate = parser.value("video-bitrate").toInt() * 1000;
+    if (parser.isSet("jobs"))
+        options.threads = parser.value("jobs").toInt();
+    if (parser.isSet("memory"))
+        options.memoryMB = parser.value("memory").toInt();
+
+    if (parser.positionalArguments().isEmpty()) {
+        qWarning("No files or dirs to export!");
+        return 1;
+    }
+
+    DVBatchExporter exporter(options);
+
+    return exporter.run(parser.positionalArguments()) == 0 ? 0 : 1;
+}
+}
 
 int main(int argc, char* argv[]) {
-    QCoreApplication::setAttribute(Qt::AA_UseDesktopOpenGL);
-    QApplication app(argc, argv);
+    const bool headless = exportRequested(argc, argv);
+
+    if (!headless)
+        QCoreApplication::setAttribute(Qt::AA_UseDesktopOpenGL);
 
-    app.setOrganizationName("chipgw");
-    app.setApplicationName("DepthView2");
-    app.setApplicationVersion(version::number.toString());
+    QScopedPointer<QCoreApplication> app(headless ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
 
-    /* QML needs a stencil buffer. */
-    QSurfaceFormat fmt;
-    fmt.setDepthBufferSize(24);
-    fmt.setStencilBufferSize(8);
-    QSurfaceFormat::setDefaultFormat(fmt);
+    app->setOrganizationName("chipgw");
+    app->setApplicationName("DepthView2");
+    app->setApplicationVersion(version::number.toString());
+
+    if (!headless) {
+        /* QML needs a stencil buffer. */
+        QSurfaceFormat fmt;
+        fmt.setDepthBufferSize(24);
+        fmt.setStencilBufferSize(8);
+        QSurfaceFormat::setDefaultFormat(fmt);
+    }
 
     QCommandLineParser parser;
 
@@ -36,14 +109,55 @@ int main(int argc, char* argv[]) {
               QCoreApplication::translate("main", "Set the render mode."),
               QCoreApplication::translate("main", "renderer")},
             { {"l", "list-modes"},
-              QCoreApplication::translate("main", "List valid render modes to console during startup.")}
+              QCoreApplication::translate("main", "List valid render modes to console during startup.")},
+            { {"x", "export"},
+              QCoreApplication::translate("main", "Convert the images, videos and dirs given to another stereo layout in the specified directory, without opening a window."),
+              QCoreApplication::translate("main", "directory")},
+            { "output-mode",
+              QCoreApplication::translate("main", "Render mode of exported files. (Default SideBySide)"),
+              QCoreApplication::translate("main", "renderer")},
+            { "source-mode",
+              QCoreApplication::translate("main", "Stereo layout of the files to export, otherwise worked out from each file's name or contents."),
+              QCoreApplication::translate("main", "mode")},
+            { "swap",
+              QCoreApplication::translate("main", "Swap the eyes of exported files.")},
+            { "anamorphic",
+              QCoreApplication::translate("main", "Squeeze exported side-by-side and top/bottom images to the size of one eye.")},
+            { "mirror-left",
+              QCoreApplication::translate("main", "Mirror the left eye of exported side-by-side and top/bottom images.")},
+            { "mirror-right",
+              QCoreApplication::translate("main", "Mirror the right eye of exported side-by-side and top/bottom images.")},
+            { "grey",
+              QCoreApplication::translate("main", "How grey exported anaglyph images are, from 0 to 1. (Default 0)"),
+              QCoreApplication::translate("main", "factor")},
+            { "format",
+              QCoreApplication::translate("main", "Image format of exported images. (Default jpg)"),
+              QCoreApplication::translate("main", "format")},
+            { "quality",
+              QCoreApplication::translate("main", "Quality of exported images, from 0 to 100. (Default 90)"),
+              QCoreApplication::translate("main", "quality")},
+            { "video-format",
+              QCoreApplication::translate("main", "Container of exported videos, by file suffix. Only the video is exported, not the audio. (Default mp4)"),
+              QCoreApplication::translate("main", "suffix")},
+            { "video-codec",
+              QCoreApplication::translate("main", "FFmpeg encoder for exported videos. (Default libx264)"),
+              QCoreApplication::translate("main", "codec")},
+            { "video-bitrate",
+              QCoreApplication::translate("main", "Bitrate of exported videos, in kilobits per second. (Default chosen by the encoder)"),
+              QCoreApplication::translate("main", "kbps")},
+            { {"j", "jobs"},
+              QCoreApplication::translate("main", "Number of files to export at once. (Default one per core)"),
+              QCoreApplication::translate("main", "count")},
+            { "memory",
+              QCoreApplication::translate("main", "Memory to use for exporting at most, in megabytes. (Default 1024)"),
+              QCoreApplication::translate("main", "megabytes")}
         });
 
     parser.addHelpOption();
     parser.addVersionOption();
-    parser.addPositionalArgument("file", "A file to open.");
+    parser.addPositionalArgument("file", "A file to open, or files and dirs to export.");
 
-    parser.process(app.arguments());
+    parser.process(app->arguments());
 
     /* Print the valid modes to the console. */
     if (parser.isSet("l")) {
@@ -59,6 +173,10 @@ int main(int argc, char* argv[]) {
 
         return 0;
     }
+
+    if (headless)
+        return runExport(parser);
+
 #ifdef DV_FILE_ASSOCIATION
     if (parser.isSet("register")){
         DVQmlCommunication::registerFileTypes();
@@ -71,5 +189,5 @@ int main(int argc, char* argv[]) {
     DVWindowHook windowHook(&applicationEngine);
     windowHook.doCommandLine(parser);
 
-    return app.exec();
+    return app->exec();
 }